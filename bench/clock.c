@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <xcb/xcb.h>
+
+/*
+ * The idle desktop for bench/wakeups.sh, a window that retitles itself
+ * like a clock applet until killed.
+ *
+ *  title-clock [interval in milliseconds]
+ */
+
+static xcb_atom_t intern_atom(xcb_connection_t *connection, char *name) {
+    xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(connection,
+        xcb_intern_atom(connection, 0, strlen(name), name), NULL);
+    xcb_atom_t atom = reply ? reply->atom : XCB_ATOM_NONE;
+
+    free(reply);
+
+    return atom;
+}
+
+int main(int argc, char **argv) {
+    unsigned long interval = argc >= 2 ? strtoul(argv[1], NULL, 10) : 1000;
+    struct timespec pause = {
+        interval / 1000, (interval % 1000) * 1000000L
+    };
+    xcb_connection_t *connection;
+    xcb_screen_t *screen;
+    xcb_window_t window;
+    xcb_atom_t name_atom;
+    xcb_atom_t utf8_atom;
+    char title[64];
+    unsigned int length;
+    time_t now;
+
+    connection = xcb_connect(NULL, NULL);
+    if (xcb_connection_has_error(connection)) {
+        fprintf(stderr, "%s: unable to connect to X\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    screen = xcb_setup_roots_iterator(xcb_get_setup(connection)).data;
+
+    name_atom = intern_atom(connection, "_NET_WM_NAME");
+    utf8_atom = intern_atom(connection, "UTF8_STRING");
+
+    window = xcb_generate_id(connection);
+    xcb_create_window(connection, XCB_COPY_FROM_PARENT, window, screen->root,
+        0, 0, 200, 20, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+        screen->root_visual, 0, NULL);
+    xcb_map_window(connection, window);
+
+    /* Both names, as a toolkit would set them */
+    for (unsigned long tick = 0;; tick++) {
+        now = time(NULL);
+        length = strftime(title, sizeof(title), "%H:%M:%S", localtime(&now));
+        length += snprintf(title + length, sizeof(title) - length, " #%lu",
+            tick);
+
+        xcb_change_property(connection, XCB_PROP_MODE_REPLACE, window,
+            XCB_ATOM_WM_NAME, XCB_ATOM_STRING, 8, length, title);
+        if (name_atom != XCB_ATOM_NONE && utf8_atom != XCB_ATOM_NONE)
+            xcb_change_property(connection, XCB_PROP_MODE_REPLACE, window,
+                name_atom, utf8_atom, 8, length, title);
+
+        if (xcb_flush(connection) <= 0)
+            return EXIT_FAILURE;
+
+        nanosleep(&pause, NULL);
+    }
+}
@@ -0,0 +1,252 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/ipc/socket.h"
+#include "../src/log.h"
+
+/*
+ * IPC throughput without X, driven by bench/ipc.sh; run with make bench.
+ *
+ *  ipc-bench serve [--quiet]   stand in for custard, counting geometry
+ *  ipc-bench send [count]      pipeline geometry commands, then count
+ *  ipc-bench wait [count]      poll until the server has seen count
+ *
+ * The server goes through socket.c, protocol.c and ring.c exactly like
+ * custard does, only the commands themselves do nothing. With --quiet
+ * geometry is never answered, the socket then carries the same traffic
+ * as a ring and the two can be compared like for like.
+ */
+
+#define FIXED_DESCRIPTORS 2
+
+/* What custardc --batch would send for a typical keybinding */
+static char geometry_command[] = "geometry\0*\0main\0" "12x12\0" "0,0";
+
+static unsigned long geometry_commands = 0;
+static unsigned short quiet = 0;
+static unsigned short serving = 1;
+
+static void process_input(ipc_tokens_t *input) {
+    char *qualifier = next_token(input);
+    char count[32];
+
+    if (!qualifier)
+        return;
+
+    if (!strcmp(qualifier, "geometry"))
+        geometry_commands++;
+    else if (!strcmp(qualifier, "count")) {
+        snprintf(count, sizeof(count), "%lu\n", geometry_commands);
+        respond_to_command(count);
+    } else if (!strcmp(qualifier, "reset"))
+        geometry_commands = 0;
+    else if (!strcmp(qualifier, "halt"))
+        serving = 0;
+    else if (!strcmp(qualifier, "ring") && command_connection &&
+        !offer_ring(command_connection))
+        respond_to_command("Ring unavailable\n");
+}
+
+static void drain_ring(ipc_ring_t *ring) {
+    ipc_tokens_t tokens;
+    unsigned int length;
+    char *message;
+
+    while ((message = pull_from_ring(ring, &length))) {
+        tokenize_message(&tokens, message, length);
+        process_input(&tokens);
+    }
+}
+
+static void service_connections(struct pollfd *descriptors,
+    unsigned int count) {
+    ipc_connection_t *connection;
+    ipc_tokens_t tokens;
+    unsigned int length;
+    unsigned short answer;
+    char *message;
+
+    for (unsigned int index = count; index--;) {
+        connection = get_from_vector(ipc_connections, index);
+
+        if (connection->state == CONNECTION_WRITING &&
+            (descriptors[index].revents & (POLLOUT | POLLHUP | POLLERR)))
+            write_to_connection(connection);
+        else if (connection->state == CONNECTION_READING &&
+            (descriptors[index].revents & (POLLIN | POLLHUP | POLLERR)))
+            read_from_connection(connection);
+
+        while (connection->state == CONNECTION_READING &&
+            (message = next_message(connection, &length))) {
+            /* Unanswered, geometry costs only the read and the parse */
+            answer = !quiet || strncmp(message, "geometry", length);
+            tokenize_message(&tokens, message, length);
+
+            if (answer)
+                start_command(connection);
+            process_input(&tokens);
+            if (answer)
+                finish_command(connection);
+        }
+
+        if (connection->state == CONNECTION_READING && connection->closing)
+            connection->state = CONNECTION_CLOSED;
+
+        if (connection->state == CONNECTION_CLOSED) {
+            if (connection->ring)
+                drain_ring(connection->ring);
+            close_connection(index);
+        }
+    }
+}
+
+static void service_rings() {
+    ipc_connection_t *connection;
+    uint64_t count;
+
+    while (read(ring_file_descriptor, &count, sizeof(count)) < 0 &&
+        errno == EINTR);
+
+    for (unsigned int index = 0; index < ipc_connections->size; index++) {
+        connection = get_from_vector(ipc_connections, index);
+        if (connection->ring)
+            drain_ring(connection->ring);
+    }
+}
+
+static int serve() {
+    struct pollfd *descriptors = NULL;
+    unsigned int memory = 0;
+    unsigned int count;
+    ipc_connection_t *connection;
+
+    socket_mode = WINDOW_MANAGER;
+    if (!initialize_socket())
+        return EXIT_FAILURE;
+
+    while (serving) {
+        count = FIXED_DESCRIPTORS + ipc_connections->size;
+        if (count > memory) {
+            memory = count * 2;
+            descriptors = realloc(descriptors, memory * sizeof(*descriptors));
+        }
+
+        descriptors[0] = (struct pollfd){
+            accepting_connections ? socket_file_descriptor : -1, POLLIN, 0
+        };
+        descriptors[1] = (struct pollfd){ ring_file_descriptor, POLLIN, 0 };
+        for (unsigned int index = 0; index < ipc_connections->size;
+            index++) {
+            connection = get_from_vector(ipc_connections, index);
+            descriptors[FIXED_DESCRIPTORS + index] = (struct pollfd){
+                connection->file_descriptor,
+                connection->state == CONNECTION_WRITING ? POLLOUT : POLLIN, 0
+            };
+        }
+
+        if (poll(descriptors, count, -1) <= 0)
+            continue;
+
+        service_connections(descriptors + FIXED_DESCRIPTORS,
+            count - FIXED_DESCRIPTORS);
+        if (descriptors[1].revents & POLLIN)
+            service_rings();
+        if (descriptors[0].revents & POLLIN)
+            accept_connections();
+    }
+
+    free(descriptors);
+    finalize_socket();
+
+    return EXIT_SUCCESS;
+}
+
+static unsigned short read_exactly(char *buffer, unsigned int length) {
+    ssize_t received;
+
+    while (length) {
+        received = read(socket_file_descriptor, buffer, length);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return 0;
+
+        buffer += received;
+        length -= received;
+    }
+
+    return 1;
+}
+
+static long request_count() {
+    char command[] = "count";
+    char header[IPC_HEADER_SIZE];
+    char response[32];
+    uint32_t length;
+
+    if (!write_to_socket(command, sizeof(command)) ||
+        !read_exactly(header, IPC_HEADER_SIZE))
+        return -1;
+
+    length = read_message_header(header);
+    if (!length || length >= sizeof(response) ||
+        !read_exactly(response, length))
+        return -1;
+
+    response[length] = '\0';
+
+    return strtol(response, NULL, 10);
+}
+
+static int send_commands(unsigned long count) {
+    /* Against a quiet server, an answering one fills the socket and stalls */
+    for (unsigned long index = 0; index < count; index++)
+        if (!write_to_socket(geometry_command, sizeof(geometry_command)))
+            return EXIT_FAILURE;
+
+    return request_count() == (long)count ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int wait_for_commands(unsigned long count) {
+    struct timespec pause = { 0, 100000 };
+    long seen;
+
+    while ((seen = request_count()) >= 0 && seen < (long)count)
+        nanosleep(&pause, NULL);
+
+    return seen == (long)count ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char **argv) {
+    int status;
+
+    if (argc >= 2 && !strcmp(argv[1], "serve")) {
+        quiet = argc >= 3 && !strcmp(argv[2], "--quiet");
+        return serve();
+    }
+
+    if (argc < 3 || (strcmp(argv[1], "send") && strcmp(argv[1], "wait"))) {
+        fprintf(stderr, "usage: %s serve [--quiet] | send [count] | "
+            "wait [count]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    socket_mode = CONTROLLER;
+    if (!initialize_socket())
+        return EXIT_FAILURE;
+
+    if (!strcmp(argv[1], "send"))
+        status = send_commands(strtoul(argv[2], NULL, 10));
+    else
+        status = wait_for_commands(strtoul(argv[2], NULL, 10));
+
+    finalize_socket();
+
+    return status;
+}
@@ -0,0 +1,94 @@
+#!/bin/sh
+#
+# Geometry commands per second over each IPC path, against bench/ipc.c
+# standing in for custard so no X server is needed; run with make bench.
+#
+#  batch    custardc --batch, every command waits for its response
+#  ring     custardc --ring, no responses
+#  socket   pipelined over the socket with responses excluded, the like
+#           for like comparison with the ring
+
+BUILD=${BUILD:-build}
+COMMANDS=${COMMANDS:-100000}
+
+export USER=${USER:-$(id -un)}
+export DISPLAY=":bench$$"
+
+socket="/tmp/custard.${USER}_${DISPLAY}.sock"
+scratch=$(mktemp -d)
+status=0
+
+cleanup() {
+    [ -n "$server" ] && kill "$server" 2> /dev/null
+    rm -rf "$scratch" "$socket"
+}
+trap cleanup EXIT
+
+i=0
+while [ "$i" -lt "$COMMANDS" ]; do
+    echo "geometry * main 12x12 0,0"
+    i=$((i + 1))
+done > "$scratch/commands"
+
+now() {
+    date +%s%N
+}
+
+start_server() {
+    [ -n "$server" ] && kill "$server" 2> /dev/null && wait "$server"
+    rm -f "$socket"
+
+    "$BUILD/ipc-bench" serve "$@" &
+    server=$!
+
+    for attempt in 1 2 3 4 5 6 7 8 9 10; do
+        [ -S "$socket" ] && return 0
+        sleep 0.1
+    done
+
+    echo "ipc: server did not start"
+    exit 1
+}
+
+report() {
+    awk -v name="$1" -v count="$COMMANDS" -v start="$2" -v end="$3" \
+        'BEGIN { printf "ipc: %-7s %8.0f commands/s\n", name,
+            count / ((end - start) / 1e9) }'
+}
+
+start_server
+"$BUILD/custardc" reset
+
+start=$(now)
+if "$BUILD/custardc" --batch "$scratch/commands" &&
+    "$BUILD/ipc-bench" wait "$COMMANDS"; then
+    report batch "$start" "$(now)"
+else
+    echo "ipc: batch failed"
+    status=1
+fi
+
+"$BUILD/custardc" reset
+
+start=$(now)
+if "$BUILD/custardc" --ring "$scratch/commands" &&
+    "$BUILD/ipc-bench" wait "$COMMANDS"; then
+    report ring "$start" "$(now)"
+else
+    echo "ipc: ring failed"
+    status=1
+fi
+
+start_server --quiet
+
+start=$(now)
+if "$BUILD/ipc-bench" send "$COMMANDS"; then
+    report socket "$start" "$(now)"
+else
+    echo "ipc: socket failed"
+    status=1
+fi
+
+"$BUILD/custardc" halt
+
+exit "$status"
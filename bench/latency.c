@@ -0,0 +1,298 @@
+#include <poll.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#include <xcb/xcb.h>
+#include <xcb/xtest.h>
+
+/*
+ * Latency as a client sees it, driven by bench/latency.sh; run with
+ * make bench.
+ *
+ *  latency-probe click [samples]
+ *      XTest click on an unfocused window until its FocusIn
+ *  latency-probe configure [samples] [custardc]
+ *      custardc window geometry until the ConfigureNotify
+ *  latency-probe hog [megabytes]
+ *      memory load until killed
+ *
+ * The windows ask for the classes latency-left and latency-right, the
+ * script places them with rules. Prints the median and the 99th
+ * percentile in microseconds.
+ */
+
+/* Microseconds a sample may take before it counts as missed */
+#define SAMPLE_TIMEOUT 1000000
+
+extern char **environ;
+
+static xcb_connection_t *connection;
+static xcb_screen_t *screen;
+
+static long elapsed_since(struct timespec *start) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) * 1000000L +
+        (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+static xcb_window_t create_probe_window(char *class) {
+    xcb_window_t window = xcb_generate_id(connection);
+    uint32_t events = XCB_EVENT_MASK_STRUCTURE_NOTIFY |
+        XCB_EVENT_MASK_FOCUS_CHANGE;
+    char class_hint[64];
+    int length;
+
+    xcb_create_window(connection, XCB_COPY_FROM_PARENT, window, screen->root,
+        0, 0, 100, 100, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+        screen->root_visual, XCB_CW_EVENT_MASK, &events);
+
+    /* WM_CLASS is the instance and the class, each NUL-terminated */
+    length = snprintf(class_hint, sizeof(class_hint), "%s%c%s", class, '\0',
+        class) + 1;
+    xcb_change_property(connection, XCB_PROP_MODE_REPLACE, window,
+        XCB_ATOM_WM_CLASS, XCB_ATOM_STRING, 8, length, class_hint);
+
+    xcb_map_window(connection, window);
+
+    return window;
+}
+
+static xcb_generic_event_t *wait_for_event(xcb_window_t window,
+    uint8_t type, struct timespec *start) {
+    struct pollfd descriptor = {
+        xcb_get_file_descriptor(connection), POLLIN, 0
+    };
+    xcb_generic_event_t *event;
+    xcb_window_t target;
+    long remaining;
+
+    for (;;) {
+        while ((event = xcb_poll_for_event(connection))) {
+            target = XCB_WINDOW_NONE;
+
+            if ((event->response_type & ~0x80) != type)
+                ;
+            else if (type == XCB_FOCUS_IN && ((xcb_focus_in_event_t*)
+                event)->detail != XCB_NOTIFY_DETAIL_POINTER)
+                target = ((xcb_focus_in_event_t*)event)->event;
+            else if (type == XCB_CONFIGURE_NOTIFY)
+                target = ((xcb_configure_notify_event_t*)event)->window;
+            else if (type == XCB_MAP_NOTIFY)
+                target = ((xcb_map_notify_event_t*)event)->window;
+
+            if (target == window)
+                return event;
+
+            free(event);
+        }
+
+        if (xcb_connection_has_error(connection) ||
+            (remaining = SAMPLE_TIMEOUT - elapsed_since(start)) <= 0)
+            return NULL;
+
+        poll(&descriptor, 1, remaining / 1000 + 1);
+    }
+}
+
+static void discard_events() {
+    xcb_generic_event_t *event;
+
+    while ((event = xcb_poll_for_event(connection)))
+        free(event);
+}
+
+static unsigned short wait_until_managed(xcb_window_t window) {
+    struct timespec start;
+    xcb_generic_event_t *event;
+
+    /* Mapped once the window manager has reparented and shown it */
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (!(event = wait_for_event(window, XCB_MAP_NOTIFY, &start)))
+        return 0;
+
+    free(event);
+
+    return 1;
+}
+
+static long click(xcb_window_t window) {
+    xcb_translate_coordinates_reply_t *center;
+    xcb_get_geometry_reply_t *geometry;
+    xcb_generic_event_t *event;
+    struct timespec start;
+
+    geometry = xcb_get_geometry_reply(connection,
+        xcb_get_geometry(connection, window), NULL);
+    if (!geometry)
+        return -1;
+
+    center = xcb_translate_coordinates_reply(connection,
+        xcb_translate_coordinates(connection, window, screen->root,
+        geometry->width / 2, geometry->height / 2), NULL);
+    free(geometry);
+    if (!center)
+        return -1;
+
+    discard_events();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    xcb_test_fake_input(connection, XCB_MOTION_NOTIFY, 0, XCB_CURRENT_TIME,
+        screen->root, center->dst_x, center->dst_y, 0);
+    xcb_test_fake_input(connection, XCB_BUTTON_PRESS, 1, XCB_CURRENT_TIME,
+        XCB_NONE, 0, 0, 0);
+    xcb_test_fake_input(connection, XCB_BUTTON_RELEASE, 1, XCB_CURRENT_TIME,
+        XCB_NONE, 0, 0, 0);
+    xcb_flush(connection);
+    free(center);
+
+    if (!(event = wait_for_event(window, XCB_FOCUS_IN, &start)))
+        return -1;
+
+    free(event);
+
+    return elapsed_since(&start);
+}
+
+static long configure(xcb_window_t window, char *controller, char *label,
+    uint16_t *width) {
+    char *arguments[] = { controller, "window", "geometry", label, NULL };
+    xcb_configure_notify_event_t *event;
+    struct timespec start;
+    pid_t child;
+    long latency = -1;
+
+    discard_events();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (posix_spawnp(&child, controller, NULL, NULL, arguments, environ))
+        return -1;
+
+    /* Only a change of size is the answer to this command */
+    while ((event = (xcb_configure_notify_event_t*)wait_for_event(window,
+        XCB_CONFIGURE_NOTIFY, &start))) {
+        if (event->width != *width) {
+            latency = elapsed_since(&start);
+            *width = event->width;
+            free(event);
+            break;
+        }
+
+        free(event);
+    }
+
+    waitpid(child, NULL, 0);
+
+    return latency;
+}
+
+static int compare_samples(const void *first, const void *second) {
+    long difference = *(const long*)first - *(const long*)second;
+
+    return (difference > 0) - (difference < 0);
+}
+
+static void report(char *name, long *samples, unsigned int count,
+    unsigned int missed) {
+    if (!count) {
+        printf("%s: no samples, %u missed\n", name, missed);
+        return;
+    }
+
+    qsort(samples, count, sizeof(*samples), compare_samples);
+    printf("%s: p50 %ldus p99 %ldus over %u samples, %u missed\n", name,
+        samples[count / 2], samples[(count * 99 + 99) / 100 - 1], count,
+        missed);
+}
+
+static int hog(unsigned long megabytes) {
+    unsigned long size = megabytes << 20;
+    unsigned char *memory = malloc(size);
+
+    if (!memory)
+        return EXIT_FAILURE;
+
+    /* Keeps every page resident and the memory bus busy */
+    for (unsigned char pass = 0;; pass++)
+        memset(memory, pass, size);
+}
+
+int main(int argc, char **argv) {
+    xcb_window_t windows[2];
+    unsigned int samples;
+    unsigned int count = 0;
+    unsigned int missed = 0;
+    uint16_t width = 0;
+    long *latencies;
+    long latency;
+
+    if (argc >= 3 && !strcmp(argv[1], "hog"))
+        return hog(strtoul(argv[2], NULL, 10));
+
+    if (argc < 3 || (strcmp(argv[1], "click") &&
+        (strcmp(argv[1], "configure") || argc < 4))) {
+        fprintf(stderr, "usage: %s click [samples] | configure [samples] "
+            "[custardc] | hog [megabytes]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    samples = strtoul(argv[2], NULL, 10);
+    if (!samples || !(latencies = calloc(samples, sizeof(*latencies))))
+        return EXIT_FAILURE;
+
+    connection = xcb_connect(NULL, NULL);
+    if (xcb_connection_has_error(connection)) {
+        fprintf(stderr, "%s: unable to connect to X\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    screen = xcb_setup_roots_iterator(xcb_get_setup(connection)).data;
+
+    windows[0] = create_probe_window("latency-left");
+    windows[1] = create_probe_window("latency-right");
+    xcb_flush(connection);
+
+    if (!wait_until_managed(windows[0]) || !wait_until_managed(windows[1])) {
+        fprintf(stderr, "%s: windows were never managed\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    /* The window command acts on the focused window */
+    if (!strcmp(argv[1], "configure")) {
+        xcb_get_geometry_reply_t *geometry;
+
+        if (click(windows[0]) < 0 || !(geometry = xcb_get_geometry_reply(
+            connection, xcb_get_geometry(connection, windows[0]), NULL))) {
+            fprintf(stderr, "%s: unable to focus the window\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        width = geometry->width;
+        free(geometry);
+    }
+
+    for (unsigned int sample = 0; sample < samples; sample++) {
+        if (!strcmp(argv[1], "click"))
+            latency = click(windows[(sample + 1) % 2]);
+        else
+            latency = configure(windows[0], argv[3],
+                sample % 2 ? "left" : "wide", &width);
+
+        if (latency < 0)
+            missed++;
+        else
+            latencies[count++] = latency;
+    }
+
+    report(argv[1], latencies, count, missed);
+
+    free(latencies);
+    xcb_disconnect(connection);
+
+    return missed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
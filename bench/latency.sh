@@ -0,0 +1,89 @@
+#!/bin/sh
+#
+# p99 of click to focus and custardc window to ConfigureNotify while
+# every core spins and a memory hog streams through RAM, first in the
+# default mode and then with --low-latency. Needs Xvfb and a built tree;
+# run with make bench. fifo and rr need CAP_SYS_NICE, without it custard
+# logs the failure and the two runs measure the same thing.
+
+BUILD=${BUILD:-build}
+DISPLAY_NUMBER=${DISPLAY_NUMBER:-:74}
+SAMPLES=${SAMPLES:-500}
+LATENCY_MODE=${LATENCY_MODE:-fifo}
+HOG_MEGABYTES=${HOG_MEGABYTES:-256}
+
+if ! command -v Xvfb > /dev/null; then
+    echo "latency: Xvfb not found, skipped"
+    exit 0
+fi
+
+export USER=${USER:-$(id -un)}
+export DISPLAY="$DISPLAY_NUMBER"
+
+scratch=$(mktemp -d)
+export XDG_CONFIG_HOME="$scratch"
+socket="/tmp/custard.${USER}_${DISPLAY}.sock"
+load=""
+status=0
+
+stop_custard() {
+    [ -n "$custard" ] && kill "$custard" 2> /dev/null && wait "$custard"
+    custard=""
+}
+
+cleanup() {
+    stop_custard
+    [ -n "$load" ] && kill $load 2> /dev/null
+    [ -n "$server" ] && kill "$server" 2> /dev/null
+    rm -rf "$scratch"
+}
+trap cleanup EXIT
+
+Xvfb "$DISPLAY_NUMBER" -nolisten tcp +extension XTEST > /dev/null 2>&1 &
+server=$!
+sleep 1
+
+# One spinning shell per core and the hog, for every run alike
+for core in $(seq "$(nproc)"); do
+    sh -c 'while :; do :; done' &
+    load="$load $!"
+done
+"$BUILD/latency-probe" hog "$HOG_MEGABYTES" &
+load="$load $!"
+
+measure() {
+    name=$1
+    shift
+
+    rm -f "$socket"
+    "$BUILD/custard" "$@" > "$scratch/log-$name" 2>&1 &
+    custard=$!
+
+    for attempt in 1 2 3 4 5 6 7 8 9 10; do
+        [ -S "$socket" ] && break
+        sleep 0.5
+    done
+
+    "$BUILD/custardc" --batch > /dev/null <<COMMANDS
+geometry * left 1x1 0,0 * right 1x1 1,0 * wide 2x1 0,0
+match window.class ^latency-left\$ geometry left
+match window.class ^latency-right\$ geometry right
+COMMANDS
+
+    for probe in click configure; do
+        if ! "$BUILD/latency-probe" "$probe" "$SAMPLES" "$BUILD/custardc" \
+            > "$scratch/$probe"; then
+            echo "latency: $name $probe failed"
+            cat "$scratch/log-$name"
+            status=1
+        fi
+        sed "s/^/latency: $name /" "$scratch/$probe"
+    done
+
+    stop_custard
+}
+
+measure default
+measure low-latency --low-latency "$LATENCY_MODE"
+
+exit "$status"
@@ -0,0 +1,87 @@
+#!/bin/sh
+#
+# Wakeups per second of an idle custard while a clock retitles its
+# window, for each build given; run with make bench. The voluntary
+# context switches of the main thread count every return from poll.
+# Needs Xvfb. To compare with an earlier revision:
+#
+#  git worktree add /tmp/before <revision> && make -C /tmp/before
+#  sh bench/wakeups.sh /tmp/before/build build
+
+BUILD=${BUILD:-build}
+DISPLAY_NUMBER=${DISPLAY_NUMBER:-:75}
+DURATION=${DURATION:-10}
+INTERVAL=${INTERVAL:-1000}
+
+if ! command -v Xvfb > /dev/null; then
+    echo "wakeups: Xvfb not found, skipped"
+    exit 0
+fi
+
+[ "$#" -eq 0 ] && set -- "$BUILD"
+
+export USER=${USER:-$(id -un)}
+export DISPLAY="$DISPLAY_NUMBER"
+
+scratch=$(mktemp -d)
+export XDG_CONFIG_HOME="$scratch"
+socket="/tmp/custard.${USER}_${DISPLAY}.sock"
+status=0
+
+stop() {
+    [ -n "$clock" ] && kill "$clock" 2> /dev/null
+    [ -n "$custard" ] && kill "$custard" 2> /dev/null && wait "$custard"
+    clock=""
+    custard=""
+}
+
+cleanup() {
+    stop
+    [ -n "$server" ] && kill "$server" 2> /dev/null
+    rm -rf "$scratch"
+}
+trap cleanup EXIT
+
+switches() {
+    awk '/^voluntary_ctxt_switches/ { print $2 }' "/proc/$1/status"
+}
+
+Xvfb "$DISPLAY_NUMBER" -nolisten tcp > /dev/null 2>&1 &
+server=$!
+sleep 1
+
+for build in "$@"; do
+    rm -f "$socket"
+    "$build/custard" > "$scratch/log" 2>&1 &
+    custard=$!
+
+    for attempt in 1 2 3 4 5 6 7 8 9 10; do
+        [ -S "$socket" ] && break
+        sleep 0.5
+    done
+
+    # The clock comes from this tree so every build sees the same client
+    "$BUILD/title-clock" "$INTERVAL" &
+    clock=$!
+    sleep 1
+
+    if ! before=$(switches "$custard"); then
+        echo "wakeups: $build/custard did not start"
+        cat "$scratch/log"
+        status=1
+        stop
+        continue
+    fi
+
+    sleep "$DURATION"
+    after=$(switches "$custard")
+
+    awk -v build="$build" -v count=$((after - before)) \
+        -v duration="$DURATION" -v interval="$INTERVAL" \
+        'BEGIN { printf "wakeups: %s %.1f/s, title every %dms\n", build,
+            count / duration, interval }'
+
+    stop
+done
+
+exit "$status"
@@ -0,0 +1,10 @@
+#include "ipc/controller.h"
+
+/*
+ * The controller on its own, without X or PCRE, for keybindings that
+ * start a process on every keypress. custardc [command] is the same as
+ * custard - [command].
+ */
+int main(int argc, char** argv) {
+    return controller(argc - 1, argv + 1);
+}
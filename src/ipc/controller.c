@@ -1,3 +1,4 @@
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,7 +6,7 @@
 #include "controller.h"
 #include "socket.h"
 
-#include "../wm/custard.h"
+#include "../log.h"
 
 unsigned short should_become_controller(int argc, char** argv) {
     if (argc >= 2 && !strcmp(argv[1], "-"))
@@ -14,26 +15,164 @@ unsigned short should_become_controller(int argc, char** argv) {
     return 0;
 }
 
+static unsigned int tokenize_line(char *line) {
+    /*
+     * Rewrites a line into a command payload in place. Tokens are split
+     * on whitespace, quotes group and backslashes escape, a '#' outside
+     * of a token starts a comment.
+     */
+    char *source = line;
+    char *destination = line;
+    char quote;
+
+    for (;;) {
+        while (isspace((unsigned char)*source))
+            source++;
+
+        if (!*source || *source == '#')
+            break;
+
+        quote = 0;
+        for (; *source; source++) {
+            if (quote && *source == quote)
+                quote = 0;
+            else if (!quote && (*source == '\'' || *source == '"'))
+                quote = *source;
+            else if (!quote && isspace((unsigned char)*source))
+                break;
+            else if (*source == '\\' && source[1])
+                *destination++ = *++source;
+            else
+                *destination++ = *source;
+        }
+
+        /* Step past the separator before it can be overwritten */
+        if (*source)
+            source++;
+        *destination++ = '\0';
+    }
+
+    return destination - line;
+}
+
+static int controller_session(FILE *input, unsigned short stream,
+    ipc_ring_t *ring) {
+    /*
+     * Usage:
+     *  custard - --batch [file]
+     *  custard - --stream
+     *  custard - --ring [file]
+     *
+     * One command per line, all over a single connection. Streaming
+     * hands each response on as soon as it arrives, for long-lived
+     * clients such as a hotkey daemon writing into a pipe. A ring skips
+     * the socket for commands and gets no responses back.
+     */
+    char *line = NULL;
+    size_t memory = 0;
+    unsigned int length;
+    int status = EXIT_SUCCESS;
+
+    while (getline(&line, &memory, input) >= 0) {
+        if (!(length = tokenize_line(line)))
+            continue;
+
+        if (ring && length > IPC_RING_MESSAGE_LIMIT) {
+            log_message("Command over %d bytes skipped",
+                IPC_RING_MESSAGE_LIMIT);
+            status = EXIT_FAILURE;
+            continue;
+        }
+
+        if (ring) {
+            if (!push_to_ring(ring, line, length)) {
+                status = EXIT_FAILURE;
+                break;
+            }
+        } else if (!write_to_socket(line, length) ||
+            !read_response_from_socket()) {
+            status = EXIT_FAILURE;
+            break;
+        }
+
+        if (stream)
+            fflush(stdout);
+    }
+
+    free(line);
+
+    return status;
+}
+
 int controller(int argc, char** argv) {
+    /* argv holds the command alone, without the program or its "-" */
     log_debug("Instance became controller");
 
     socket_mode = CONTROLLER;
 
-    if (!initialize_socket())
+    FILE *input = NULL;
+    unsigned short stream = 0;
+    unsigned short use_ring = 0;
+    ipc_ring_t *ring = NULL;
+
+    if (argc >= 1 && (!strcmp(argv[0], "--batch") ||
+        !strcmp(argv[0], "--ring"))) {
+        use_ring = !strcmp(argv[0], "--ring");
+        input = stdin;
+        if (argc >= 2 && strcmp(argv[1], "-") && !(input = fopen(argv[1],
+            "r"))) {
+            log_fatal("Unable to open %s", argv[1]);
+            return EXIT_FAILURE;
+        }
+    } else if (argc >= 1 && !strcmp(argv[0], "--stream")) {
+        input = stdin;
+        stream = 1;
+    }
+
+    if (!initialize_socket()) {
+        if (input && input != stdin)
+            fclose(input);
+        return EXIT_FAILURE;
+    }
+
+    if (use_ring && !(ring = request_ring())) {
+        if (input != stdin)
+            fclose(input);
+        finalize_socket();
         return EXIT_FAILURE;
+    }
+
+    if (input) {
+        int status = controller_session(input, stream, ring);
+
+        if (ring)
+            destroy_ring(ring);
+        if (input != stdin)
+            fclose(input);
+        finalize_socket();
+
+        return status;
+    }
+
+    /* Arguments are sent as NUL-terminated tokens behind a length header */
+    unsigned int length = 0;
+    for (int index = 0; index < argc; index++)
+        length += strlen(argv[index]) + 1;
 
-    char* input_feed = calloc(1024, sizeof(char));
+    char *message = (char*)malloc(length + 1);
+    char *token = message;
 
-    for (int index = 2; index < argc; index++) {
-        strcat(input_feed, argv[index]);
-        input_feed[strlen(input_feed)] = '\31';
+    for (int index = 0; index < argc; index++) {
+        length = strlen(argv[index]) + 1;
+        memcpy(token, argv[index], length);
+        token += length;
     }
-    input_feed[strlen(input_feed) - 1] = '\0';
 
-    write_to_socket(input_feed);
-    free(input_feed);
+    int status = write_to_socket(message, token - message) &&
+        read_response_from_socket() ? EXIT_SUCCESS : EXIT_FAILURE;
+    free(message);
 
     finalize_socket();
 
-    return EXIT_SUCCESS;
+    return status;
 }
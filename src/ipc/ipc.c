@@ -1,86 +1,280 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "ipc.h"
 #include "parsing.h"
+#include "socket.h"
 
 #include "../wm/custard.h"
 #include "../wm/decorations.h"
 #include "../wm/geometry.h"
 #include "../wm/monitor.h"
 #include "../wm/rules.h"
+#include "../wm/watchdog.h"
 #include "../wm/window.h"
 #include "../wm/workspace.h"
 #include "../xcb/connection.h"
+#include "../xcb/statistics.h"
 #include "../xcb/window.h"
 
-void ipc_process_input(char *feed) {
-    unsigned short update = 0;
-    vector_t *input = construct_vector();
+static struct {
+    const char *name;
+    void (*handler)(ipc_tokens_t*);
+    request_statistics_t *context;
+} ipc_commands[] = {
+    { "halt",       ipc_command_halt,       NULL },
+    { "configure",  ipc_command_configure,  NULL },
+    { "geometry",   ipc_command_geometry,   NULL },
+    { "match",      ipc_command_match,      NULL },
+    { "window",     ipc_command_window,     NULL },
+    { "workspace",  ipc_command_workspace,  NULL },
+    { "focus",      ipc_command_focus,      NULL },
+    { "statistics", ipc_command_statistics, NULL },
+    { "watchdog",   ipc_command_watchdog,   NULL },
+    { "ring",       ipc_command_ring,       NULL },
+    { "query",      ipc_command_query,      NULL },
+    /* Whatever a client sends that is not a command */
+    { "unknown",    NULL,                   NULL }
+};
+
+void ipc_process_input(ipc_tokens_t *input) {
+    char *qualifier = next_token(input);
+    if (!qualifier)
+        return;
 
-    char *token;
-    while ((token = strsep(&feed, "\31")))
-        push_to_vector(input, token);
-
-    char *qualifier = vector_iterator(input);
-
-    if (!strcmp(qualifier, "halt")) {
-        custard_is_running = 0;
-    } else if (!strcmp(qualifier, "configure"))
-        ipc_command_configure(input, &update);
-    else if (!strcmp(qualifier, "geometry"))
-        ipc_command_geometry(input, &update);
-    else if (!strcmp(qualifier, "match"))
-        ipc_command_match(input, &update);
-    else if (!strcmp(qualifier, "window"))
-        ipc_command_window(input, &update);
-    else if (!strcmp(qualifier, "workspace"))
-        ipc_command_workspace(input, &update);
-    else if (!strcmp(qualifier, "focus"))
-        ipc_command_focus(input, &update);
-
-    if (update) {
-        apply();
-        update = 0;
-    }
+    /* Only known names get statistics of their own */
+    unsigned int command = 0;
+    unsigned int count = sizeof(ipc_commands) / sizeof(*ipc_commands);
+    while (command < count - 1 && strcmp(qualifier, ipc_commands[command].name))
+        command++;
+
+    if (!ipc_commands[command].context)
+        ipc_commands[command].context = find_request_context(
+            ipc_commands[command].name);
+
+    enter_request_context(ipc_commands[command].context);
 
-    deconstruct_vector(input);
+    /* Most commands do not act on the focused window, so none is named */
+    watchdog_note(request_context_name(), 0, XCB_WINDOW_NONE);
+
+    /* Changes are flushed with everything else at the end of the iteration */
+    if (ipc_commands[command].handler)
+        ipc_commands[command].handler(input);
+
+    end_request_context();
 }
 
-void ipc_helper_typecast_and_assign(kv_value_t *kv_value, char *variable,
-    char *input) {
+void ipc_command_halt(ipc_tokens_t *input) {
+    suppress_unused(input);
+    /*
+     * Usage:
+     *  custard - halt
+     */
 
-    // Assign all color values
+    custard_is_running = 0;
+}
 
-    if (!strcmp(variable, "border.color.focused") ||
-        !strcmp(variable, "border.color.unfocused") ||
-        !strcmp(variable, "border.color.background")) {
-        kv_value->color = string_to_color(input);
+static void respond_with_field(char *key, char *formatting, ...) {
+    va_list ap;
+    int length;
+    char *value;
+
+    /* Values are sized first so long class names are never cut short */
+    va_start(ap, formatting);
+    length = vsnprintf(NULL, 0, formatting, ap);
+    va_end(ap);
+
+    if (length < 0 || !(value = malloc(length + 1))) {
+        log_message("Unable to format '%s' field", key);
         return;
     }
 
-    // Assign all boolean values
+    va_start(ap, formatting);
+    vsnprintf(value, length + 1, formatting, ap);
+    va_end(ap);
 
-    if (!strcmp(variable, "border.colors.flipped")) {
-        kv_value->boolean = string_to_boolean(input);
-        return;
+    respond_to_command("\t");
+    respond_to_command(key);
+    respond_to_command("=");
+    respond_escaped(value);
+
+    free(value);
+}
+
+static void respond_with_settings(vector_t *settings) {
+    char value[1024];
+    kv_pair_t *setting;
+
+    for (unsigned int index = 0; settings && index < settings->size;
+        index++) {
+        setting = get_from_vector(settings, index);
+        ipc_helper_format_value(value, sizeof(value), setting->value,
+            setting->key);
+        respond_with_field(setting->key, "%s", value);
     }
+}
 
-    // Assign all string values
+static unsigned short drain_ring(ipc_ring_t *ring, unsigned int limit) {
+    ipc_tokens_t tokens;
+    unsigned int length;
+    char *message;
 
-    if (!strcmp(variable, "geometry") ||
-        !strcmp(variable, "monitor")) {
-        kv_value->string = (char*)calloc(1, sizeof(char));
-        strcpy(kv_value->string, input);
-        return;
+    /* Ring commands have nobody to answer to */
+    while ((message = pull_from_ring(ring, &length))) {
+        tokenize_message(&tokens, message, length);
+        ipc_process_input(&tokens);
+
+        if (limit && !--limit)
+            return !ring_is_empty(ring);
+    }
+
+    return 0;
+}
+
+void ipc_service_connections(struct pollfd *descriptors, unsigned int count) {
+    /*
+     * descriptors[index] belongs to ipc_connections[index]; connections
+     * accepted after the poll set was built have no descriptor yet.
+     */
+    ipc_connection_t *connection;
+    ipc_tokens_t tokens;
+    unsigned int length;
+    char *message;
+
+    for (unsigned int index = count; index--;) {
+        connection = get_from_vector(ipc_connections, index);
+
+        if (connection->state == CONNECTION_WRITING &&
+            (descriptors[index].revents & (POLLOUT | POLLHUP | POLLERR)))
+            write_to_connection(connection);
+        else if (connection->state == CONNECTION_READING &&
+            (descriptors[index].revents & (POLLIN | POLLHUP | POLLERR)))
+            read_from_connection(connection);
+
+        /* Pipelined commands wait while a response is still being written */
+        while (connection->state == CONNECTION_READING &&
+            (message = next_message(connection, &length))) {
+            tokenize_message(&tokens, message, length);
+
+            start_command(connection);
+            ipc_process_input(&tokens);
+            finish_command(connection);
+        }
+
+        if (connection->state == CONNECTION_READING && connection->closing)
+            connection->state = CONNECTION_CLOSED;
+
+        if (connection->state == CONNECTION_CLOSED) {
+            /* Whatever the controller queued before leaving still counts */
+            if (connection->ring)
+                drain_ring(connection->ring, 0);
+            close_connection(index);
+        }
     }
+}
+
+void ipc_service_rings() {
+    ipc_connection_t *connection;
+    unsigned short pending = 0;
+    uint64_t count;
+
+    while (read(ring_file_descriptor, &count, sizeof(count)) < 0 &&
+        errno == EINTR);
+
+    for (unsigned int index = 0; index < ipc_connections->size; index++) {
+        connection = get_from_vector(ipc_connections, index);
+        if (!connection->ring)
+            continue;
+
+        if (drain_ring(connection->ring, IPC_RING_BATCH))
+            pending = 1;
+
+        if (connection->ring->broken)
+            connection->state = CONNECTION_CLOSED;
+    }
+
+    /* Leftovers wake the next iteration once X has had its turn */
+    if (pending) {
+        count = 1;
+        while (write(ring_file_descriptor, &count, sizeof(count)) < 0 &&
+            errno == EINTR);
+    }
+}
+
+typedef enum {
+    INTEGER_SETTING = 0,
+    COLOR_SETTING,
+    BOOLEAN_SETTING,
+    STRING_SETTING
+} setting_type_t;
+
+static setting_type_t setting_type(char *variable) {
+    if (!strcmp(variable, "border.color.focused") ||
+        !strcmp(variable, "border.color.unfocused") ||
+        !strcmp(variable, "border.color.background"))
+        return COLOR_SETTING;
+
+    if (!strcmp(variable, "border.colors.flipped") ||
+        !strcmp(variable, "border.strips"))
+        return BOOLEAN_SETTING;
+
+    if (!strcmp(variable, "geometry") ||
+        !strcmp(variable, "monitor"))
+        return STRING_SETTING;
 
     // If all else fails, it's an integer
 
-    kv_value->number = string_to_integer(input);
+    return INTEGER_SETTING;
+}
+
+void ipc_helper_typecast_and_assign(kv_value_t *kv_value, char *variable,
+    char *input) {
+    switch (setting_type(variable)) {
+    case COLOR_SETTING:
+        kv_value->color = string_to_color(input);
+        break;
+    case BOOLEAN_SETTING:
+        kv_value->boolean = string_to_boolean(input);
+        break;
+    case STRING_SETTING:
+        kv_value->string = (char*)calloc(strlen(input) + 1, sizeof(char));
+        strcpy(kv_value->string, input);
+        break;
+    case INTEGER_SETTING:
+        kv_value->number = string_to_integer(input);
+        break;
+    }
 }
 
-void ipc_command_configure(vector_t *input, unsigned short *screen_update) {
+void ipc_helper_format_value(char *buffer, unsigned int size,
+    kv_value_t *kv_value, char *variable) {
+    /* In the form the same setting is given in, so answers can be replayed */
+    switch (setting_type(variable)) {
+    case COLOR_SETTING:
+        snprintf(buffer, size, "#%02x%02x%02x%02x", kv_value->color.red,
+            kv_value->color.green, kv_value->color.blue,
+            kv_value->color.alpha);
+        break;
+    case BOOLEAN_SETTING:
+        snprintf(buffer, size, "%s", kv_value->boolean ? "true" : "false");
+        break;
+    case STRING_SETTING:
+        snprintf(buffer, size, "%s",
+            kv_value->string ? kv_value->string : "");
+        break;
+    case INTEGER_SETTING:
+        snprintf(buffer, size, "%u", kv_value->number);
+        break;
+    }
+}
+
+void ipc_command_configure(ipc_tokens_t *input) {
     /*
      * Usage:
      *  custard - configure ([configurable] [value])...
@@ -91,8 +285,8 @@ void ipc_command_configure(vector_t *input, unsigned short *screen_update) {
     kv_value_t *value = NULL;
 
     while (input->remaining) {
-        variable = vector_iterator(input);
-        value_string = vector_iterator(input);
+        variable = next_token(input);
+        value_string = next_token(input);
 
         if (!(value = get_value_from_key(configuration, variable)))
             continue;
@@ -100,21 +294,11 @@ void ipc_command_configure(vector_t *input, unsigned short *screen_update) {
         ipc_helper_typecast_and_assign(value, variable, value_string);
     }
 
-    if (!windows)
-        return;
-
-    window_t *window;
-    while ((window = vector_iterator(windows))) {
-        set_window_geometry(window, window->geometry);
-        decorate(window);
-    }
-
-    *screen_update = 1;
+    /* Carried out in chunks between events, see continue_relayout */
+    schedule_relayout();
 }
 
-void ipc_command_geometry(vector_t *input, unsigned short *screen_update) {
-    suppress_unused(screen_update);
-
+void ipc_command_geometry(ipc_tokens_t *input) {
     /*
      * Usage:
      *  custard - geometry [monitor or '*'] [label] [width]x[height] [x],[y]
@@ -142,10 +326,10 @@ void ipc_command_geometry(vector_t *input, unsigned short *screen_update) {
         labeled_geometry = NULL;
         geometry = NULL;
 
-        monitor_name = vector_iterator(input);
-        label = vector_iterator(input);
-        size = vector_iterator(input);
-        position = vector_iterator(input);
+        monitor_name = next_token(input);
+        label = next_token(input);
+        size = next_token(input);
+        position = next_token(input);
 
         token = strsep(&size, "x");
 
@@ -186,23 +370,21 @@ void ipc_command_geometry(vector_t *input, unsigned short *screen_update) {
 
 }
 
-void ipc_command_match(vector_t *input, unsigned short *screen_update) {
-    suppress_unused(screen_update);
-
+void ipc_command_match(ipc_tokens_t *input) {
     if (input->size < 3) return;
 
-    char *subject = vector_iterator(input);
+    char *subject = next_token(input);
 
     if (!strcmp(subject, "monitor"))
         ipc_sub_command_match_monitor(input);
     else
-        ipc_sub_command_match_window(input);
+        ipc_sub_command_match_window(subject, input);
 }
 
-void ipc_command_window(vector_t *input, unsigned short *screen_update) {
+void ipc_command_window(ipc_tokens_t *input) {
     // Missing input
     if (input->size < 2) return;
-    char *variable = vector_iterator(input);
+    char *variable = next_token(input);
 
     /*
      * Usage:
@@ -217,7 +399,7 @@ void ipc_command_window(vector_t *input, unsigned short *screen_update) {
         window = get_window_by_id(focused_window);
 
     if (!strcmp(variable, "close")) {
-        close_window(focused_window);
+        close_window(focused_window, window ? window->protocols : 0);
     } else if (!strcmp(variable, "raise")) {
 
         if (window)
@@ -230,7 +412,7 @@ void ipc_command_window(vector_t *input, unsigned short *screen_update) {
         if (!window || window->floating)
             return;
 
-        char *cardinal = vector_iterator(input);
+        char *cardinal = next_token(input);
         grid_geometry_t *geometry = (grid_geometry_t*)window->geometry;
 
         if (!strcmp(cardinal, "north")) {
@@ -257,7 +439,7 @@ void ipc_command_window(vector_t *input, unsigned short *screen_update) {
         if (!window || window->floating)
             return;
 
-        char *cardinal = vector_iterator(input);
+        char *cardinal = next_token(input);
         grid_geometry_t *geometry = (grid_geometry_t*)window->geometry;
 
         if (!strcmp(cardinal, "north")) {
@@ -288,7 +470,7 @@ void ipc_command_window(vector_t *input, unsigned short *screen_update) {
         if (!window || window->floating)
             return;
 
-        char *cardinal = vector_iterator(input);
+        char *cardinal = next_token(input);
         grid_geometry_t *geometry = (grid_geometry_t*)window->geometry;
 
         if (!strcmp(cardinal, "north")) {
@@ -318,7 +500,7 @@ void ipc_command_window(vector_t *input, unsigned short *screen_update) {
 
     } else if (!strcmp(variable, "workspace")) {
 
-        unsigned int workspace = string_to_integer(vector_iterator(input));
+        unsigned int workspace = string_to_integer(next_token(input));
 
         if (window) {
             if (window->workspace == workspace)
@@ -332,7 +514,7 @@ void ipc_command_window(vector_t *input, unsigned short *screen_update) {
         }
 
     } else if (!strcmp(variable, "geometry")) {
-        char *label = vector_iterator(input);
+        char *label = next_token(input);
 
         grid_geometry_t *geometry = (grid_geometry_t *)calloc(1,
             sizeof(grid_geometry_t));
@@ -351,6 +533,8 @@ void ipc_command_window(vector_t *input, unsigned short *screen_update) {
         window_t *window = get_window_by_id(focused_window);
         if (window) {
             window->floating = 0;
+            /* The geometry was looked up on the monitor with the cursor */
+            window->monitor = monitor;
 
             free(window->geometry);
             set_window_geometry(window, geometry);
@@ -366,8 +550,8 @@ void ipc_command_window(vector_t *input, unsigned short *screen_update) {
         unsigned int x;
         unsigned int y;
 
-        size = vector_iterator(input);
-        position = vector_iterator(input);
+        size = next_token(input);
+        position = next_token(input);
 
         token = strsep(&size, "x");
 
@@ -390,28 +574,27 @@ void ipc_command_window(vector_t *input, unsigned short *screen_update) {
             decorate(window);
         }
     }
-
-    *screen_update = 1;
 }
 
-void ipc_command_workspace(vector_t *input, unsigned short *screen_update) {
+void ipc_command_workspace(ipc_tokens_t *input) {
     monitor_t *monitor = monitor_with_cursor_residence();
 
-    unsigned int workspace = string_to_integer(vector_iterator(input));
+    unsigned int workspace = string_to_integer(next_token(input));
     if (workspace) {
         show_workspace_on_monitor(monitor, workspace);
     }
-
-    *screen_update = 1;
 }
 
-void ipc_command_focus(vector_t *input, unsigned short *screen_update) {
+void ipc_command_focus(ipc_tokens_t *input) {
     suppress_unused(input);
 
     unsigned short passed = 0;
 
     monitor_t *monitor = monitor_with_cursor_residence();
 
+    if (!windows)
+        return;
+
     window_t *window;
     while ((window = vector_iterator(windows))) {
         if (window->workspace != monitor->workspace)
@@ -434,25 +617,15 @@ void ipc_command_focus(vector_t *input, unsigned short *screen_update) {
             xcb_window_t previous_window = focused_window;
             focused_window = window->id;
 
-            xcb_ungrab_button(xcb_connection,
-                XCB_BUTTON_INDEX_ANY, window->id, XCB_MOD_MASK_ANY);
             raise_window(window->parent);
             decorate(window);
             focus_window(window->id);
 
             if (previous_window != XCB_WINDOW_NONE) {
                 window = get_window_by_id(previous_window);
-                xcb_grab_button(xcb_connection, 0, previous_window,
-                    XCB_EVENT_MASK_BUTTON_PRESS,
-                    XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC,
-                    XCB_NONE, XCB_NONE,
-                    XCB_BUTTON_INDEX_ANY ^ \
-                        XCB_BUTTON_INDEX_4 ^ XCB_BUTTON_INDEX_5,
-                    XCB_MOD_MASK_ANY);
                 decorate(window);
             }
 
-            *screen_update = 1;
             return;
         }
     }
@@ -460,8 +633,8 @@ void ipc_command_focus(vector_t *input, unsigned short *screen_update) {
 
 /* Sub-commands */
 
-void ipc_sub_command_match_monitor(vector_t *input) {
-    char *monitor_name = vector_iterator(input);
+void ipc_sub_command_match_monitor(ipc_tokens_t *input) {
+    char *monitor_name = next_token(input);
     monitor_t *monitor = monitor_from_name(monitor_name);
 
     if (!monitor)
@@ -486,8 +659,8 @@ void ipc_sub_command_match_monitor(vector_t *input) {
     char *value_string;
 
     while (input->remaining) {
-        variable = vector_iterator(input);
-        value_string = vector_iterator(input);
+        variable = next_token(input);
+        value_string = next_token(input);
 
         log_debug("%s = %s", variable, value_string);
 
@@ -503,16 +676,14 @@ void ipc_sub_command_match_monitor(vector_t *input) {
 
 }
 
-void ipc_sub_command_match_window(vector_t *input) {
+void ipc_sub_command_match_window(char *subject, ipc_tokens_t *input) {
     /*
      * Usage:
      *  custard - match window.name [expression] ([configurable] [value])...
      * custard - match window.class [expression] ([configurable] [value])...
      */
 
-    input->remaining++;
-    char *subject = vector_iterator(input);
-    char *expression = vector_iterator(input);
+    char *expression = next_token(input);
 
     window_attribute_t attribute;
 
@@ -526,7 +697,7 @@ void ipc_sub_command_match_window(vector_t *input) {
     if (!rule->rules)
         rule->rules = construct_vector();
 
-    char *configurables[10] = {
+    char *configurables[11] = {
         "borders",
         "border.size.outer",
         "border.size.inner",
@@ -534,6 +705,7 @@ void ipc_sub_command_match_window(vector_t *input) {
         "border.color.unfocused",
         "border.color.background",
         "border.colors.flipped",
+        "border.strips",
         "geometry",
         "monitor",
         "workspace"
@@ -545,10 +717,10 @@ void ipc_sub_command_match_window(vector_t *input) {
     char *value_string;
 
     while (input->remaining > 0) {
-        variable = vector_iterator(input);
-        value_string = vector_iterator(input);
+        variable = next_token(input);
+        value_string = next_token(input);
 
-        for (index = 0; index < 10;) {
+        for (index = 0; index < 11;) {
             if (!strcmp(configurables[index++], variable)) {
                 setting = create_or_get_kv_pair(rule->rules, variable);
                 ipc_helper_typecast_and_assign(setting->value,
@@ -560,3 +732,224 @@ void ipc_sub_command_match_window(vector_t *input) {
 
     add_rule(rule);
 }
+
+void ipc_command_statistics(ipc_tokens_t *input) {
+    suppress_unused(input);
+    /*
+     * Usage:
+     *  custard - statistics
+     */
+
+    char *statistics = format_request_statistics();
+    respond_to_command(statistics);
+    log_request_statistics();
+    free(statistics);
+}
+
+void ipc_command_ring(ipc_tokens_t *input) {
+    suppress_unused(input);
+
+    /*
+     * Usage:
+     *  custard - ring
+     *
+     * Hands the connection a shared memory ring for further commands,
+     * see src/ipc/ring.h. Only useful to a controller that maps it.
+     */
+
+    if (command_connection && !offer_ring(command_connection))
+        respond_to_command("Ring unavailable\n");
+}
+
+void ipc_command_query(ipc_tokens_t *input) {
+    /*
+     * Usage:
+     *  custard - query windows
+     *  custard - query monitors
+     *  custard - query workspaces
+     *  custard - query configuration
+     *  custard - query rules
+     *  custard - query geometries
+     *
+     * One record per line, its type followed by tab-separated key=value
+     * fields. Answers come from what custard already holds, nothing is
+     * asked of the X server.
+     */
+
+    char *subject = next_token(input);
+    if (!subject)
+        subject = "";
+
+    if (!strcmp(subject, "windows"))
+        ipc_sub_command_query_windows();
+    else if (!strcmp(subject, "monitors"))
+        ipc_sub_command_query_monitors();
+    else if (!strcmp(subject, "workspaces"))
+        ipc_sub_command_query_workspaces();
+    else if (!strcmp(subject, "configuration"))
+        ipc_sub_command_query_configuration();
+    else if (!strcmp(subject, "rules"))
+        ipc_sub_command_query_rules();
+    else if (!strcmp(subject, "geometries"))
+        ipc_sub_command_query_geometries();
+    else {
+        respond_to_command("error");
+        respond_with_field("message", "unknown query '%s'", subject);
+        respond_to_command("\n");
+    }
+}
+
+void ipc_command_watchdog(ipc_tokens_t *input) {
+    suppress_unused(input);
+    /*
+     * Usage:
+     *  custard - watchdog
+     */
+
+    char *report = format_stall_report();
+    respond_to_command(report);
+    free(report);
+}
+
+void ipc_sub_command_query_windows() {
+    window_t *window;
+    grid_geometry_t *geometry;
+
+    /* Created along with the first managed window */
+    for (unsigned int index = 0; windows && index < windows->size; index++) {
+        window = get_from_vector(windows, index);
+
+        respond_to_command("window");
+        respond_with_field("id", "0x%08x", window->id);
+        respond_with_field("class", "%s", window->class ? window->class : "");
+        respond_with_field("monitor", "%s",
+            window->monitor ? window->monitor->name : "");
+        respond_with_field("workspace", "%u", window->workspace);
+        respond_with_field("focused", "%u", window->id == focused_window);
+        respond_with_field("floating", "%u", window->floating);
+        respond_with_field("fullscreen", "%u", window->fullscreen);
+
+        /* Floating windows have no place on the grid */
+        if (!window->floating && window->geometry) {
+            geometry = (grid_geometry_t*)window->geometry;
+            respond_with_field("grid", "%u,%u,%u,%u", geometry->x,
+                geometry->y, geometry->width, geometry->height);
+        }
+
+        respond_with_field("pixel", "%d,%d,%u,%u", window->frame_geometry.x,
+            window->frame_geometry.y, window->frame_geometry.width,
+            window->frame_geometry.height);
+        respond_to_command("\n");
+    }
+}
+
+void ipc_sub_command_query_monitors() {
+    monitor_t *monitor;
+
+    for (unsigned int index = 0; index < monitors->size; index++) {
+        monitor = get_from_vector(monitors, index);
+
+        respond_to_command("monitor");
+        respond_with_field("name", "%s", monitor->name);
+        respond_with_field("workspace", "%u", monitor->workspace);
+        respond_with_field("workspaces", "%u",
+            get_value_from_key_with_fallback(monitor->configuration,
+            "workspaces")->number);
+        respond_with_field("pixel", "%.0f,%.0f,%.0f,%.0f",
+            monitor->geometry->x, monitor->geometry->y,
+            monitor->geometry->width, monitor->geometry->height);
+        respond_to_command("\n");
+    }
+}
+
+void ipc_sub_command_query_workspaces() {
+    monitor_t *monitor;
+    window_t *window;
+    unsigned int workspaces;
+    unsigned int count;
+
+    for (unsigned int index = 0; index < monitors->size; index++) {
+        monitor = get_from_vector(monitors, index);
+        workspaces = get_value_from_key_with_fallback(monitor->configuration,
+            "workspaces")->number;
+
+        for (unsigned int workspace = 1; workspace <= workspaces;
+            workspace++) {
+            count = 0;
+            for (unsigned int window_index = 0; windows &&
+                window_index < windows->size; window_index++) {
+                window = get_from_vector(windows, window_index);
+                if (window->monitor == monitor &&
+                    window->workspace == workspace)
+                    count++;
+            }
+
+            respond_to_command("workspace");
+            respond_with_field("monitor", "%s", monitor->name);
+            respond_with_field("number", "%u", workspace);
+            respond_with_field("visible", "%u",
+                monitor->workspace == workspace);
+            respond_with_field("windows", "%u", count);
+            respond_to_command("\n");
+        }
+    }
+}
+
+void ipc_sub_command_query_configuration() {
+    monitor_t *monitor;
+
+    respond_to_command("configuration");
+    respond_with_field("scope", "global");
+    respond_with_settings(configuration);
+    respond_to_command("\n");
+
+    /* Monitors only list what they override */
+    for (unsigned int index = 0; index < monitors->size; index++) {
+        monitor = get_from_vector(monitors, index);
+        if (!monitor->configuration)
+            continue;
+
+        respond_to_command("configuration");
+        respond_with_field("scope", "%s", monitor->name);
+        respond_with_settings(monitor->configuration);
+        respond_to_command("\n");
+    }
+}
+
+void ipc_sub_command_query_rules() {
+    rule_t *rule;
+
+    for (unsigned int index = 0; rules && index < rules->size; index++) {
+        rule = get_from_vector(rules, index);
+
+        respond_to_command("rule");
+        respond_with_field("attribute", "%s",
+            rule->attribute == class ? "window.class" : "window.name");
+        respond_with_field("expression", "%s", rule->expression);
+        respond_with_settings(rule->rules);
+        respond_to_command("\n");
+    }
+}
+
+void ipc_sub_command_query_geometries() {
+    monitor_t *monitor;
+    labeled_grid_geometry_t *labeled_geometry;
+    grid_geometry_t *geometry;
+
+    for (unsigned int index = 0; index < monitors->size; index++) {
+        monitor = get_from_vector(monitors, index);
+
+        for (unsigned int label = 0; monitor->geometries &&
+            label < monitor->geometries->size; label++) {
+            labeled_geometry = get_from_vector(monitor->geometries, label);
+            geometry = labeled_geometry->geometry;
+
+            respond_to_command("geometry");
+            respond_with_field("monitor", "%s", monitor->name);
+            respond_with_field("label", "%s", labeled_geometry->label);
+            respond_with_field("grid", "%u,%u,%u,%u", geometry->x,
+                geometry->y, geometry->width, geometry->height);
+            respond_to_command("\n");
+        }
+    }
+}
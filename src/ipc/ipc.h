@@ -1,18 +1,36 @@
 #pragma once
 
-#include "../vector.h"
+#include <poll.h>
+
+#include "protocol.h"
+
 #include "../wm/config.h"
 
-void ipc_process_input(char*);
+void ipc_process_input(ipc_tokens_t*);
+void ipc_service_connections(struct pollfd*, unsigned int);
+void ipc_service_rings(void);
 
 void ipc_helper_typecast_and_assign(kv_value_t*, char*, char*);
+void ipc_helper_format_value(char*, unsigned int, kv_value_t*, char*);
+
+void ipc_command_halt(ipc_tokens_t*);
+void ipc_command_configure(ipc_tokens_t*);
+void ipc_command_geometry(ipc_tokens_t*);
+void ipc_command_match(ipc_tokens_t*);
+void ipc_command_window(ipc_tokens_t*);
+void ipc_command_workspace(ipc_tokens_t*);
+void ipc_command_focus(ipc_tokens_t*);
+void ipc_command_statistics(ipc_tokens_t*);
+void ipc_command_watchdog(ipc_tokens_t*);
+void ipc_command_ring(ipc_tokens_t*);
+void ipc_command_query(ipc_tokens_t*);
 
-void ipc_command_configure(vector_t*, unsigned short*);
-void ipc_command_geometry(vector_t*, unsigned short*);
-void ipc_command_match(vector_t*, unsigned short*);
-void ipc_command_window(vector_t*, unsigned short*);
-void ipc_command_workspace(vector_t*, unsigned short*);
-void ipc_command_focus(vector_t*, unsigned short*);
+void ipc_sub_command_match_monitor(ipc_tokens_t *input);
+void ipc_sub_command_match_window(char *subject, ipc_tokens_t *input);
 
-void ipc_sub_command_match_monitor(vector_t *input);
-void ipc_sub_command_match_window(vector_t *input);
+void ipc_sub_command_query_windows(void);
+void ipc_sub_command_query_monitors(void);
+void ipc_sub_command_query_workspaces(void);
+void ipc_sub_command_query_configuration(void);
+void ipc_sub_command_query_rules(void);
+void ipc_sub_command_query_geometries(void);
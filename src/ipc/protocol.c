@@ -0,0 +1,46 @@
+#include <string.h>
+
+#include "protocol.h"
+
+void write_message_header(char *header, uint32_t length) {
+    header[0] = (char)(length >> 24);
+    header[1] = (char)(length >> 16);
+    header[2] = (char)(length >> 8);
+    header[3] = (char)length;
+}
+
+uint32_t read_message_header(const char *header) {
+    const unsigned char *bytes = (const unsigned char*)header;
+
+    return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 |
+        (uint32_t)bytes[2] << 8 | (uint32_t)bytes[3];
+}
+
+void tokenize_message(ipc_tokens_t *tokens, char *payload,
+    unsigned int length) {
+    /* Tokens are slices of the payload, nothing is copied */
+    char *end = payload + length;
+    char *terminator = payload;
+
+    tokens->cursor = payload;
+    tokens->size = 0;
+
+    /* Trailing bytes without a terminator are not a token */
+    while ((terminator = memchr(terminator, '\0', end - terminator))) {
+        tokens->size++;
+        terminator++;
+    }
+
+    tokens->remaining = tokens->size;
+}
+
+char *next_token(ipc_tokens_t *tokens) {
+    if (!tokens->remaining)
+        return NULL;
+
+    char *token = tokens->cursor;
+    tokens->cursor += strlen(token) + 1;
+    tokens->remaining--;
+
+    return token;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Every message is a 32-bit big-endian payload length followed by the
+ * payload. Commands carry a sequence of NUL-terminated tokens, responses
+ * carry whatever text the command produced.
+ */
+#define IPC_HEADER_SIZE 4
+
+/* Bytes read ahead of the command being handled on a connection */
+#define IPC_READ_AHEAD 65536
+
+typedef struct {
+    char *cursor;
+    unsigned int size;
+    unsigned int remaining;
+} ipc_tokens_t;
+
+void write_message_header(char*, uint32_t);
+uint32_t read_message_header(const char*);
+
+void tokenize_message(ipc_tokens_t*, char*, unsigned int);
+char *next_token(ipc_tokens_t*);
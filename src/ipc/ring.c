@@ -0,0 +1,236 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+
+#include "ring.h"
+#include "socket.h"
+
+#include "../log.h"
+
+/*
+ * Neither side sleeps on the other without a signal. The producer
+ * publishes head and then checks whether the consumer had caught up,
+ * and the consumer publishes tail and then checks head again. With a
+ * full fence between each store and load, at least one side sees the
+ * other's store. The same pairing covers waiting and tail when the
+ * ring is full.
+ */
+
+static char ring_message[IPC_RING_MESSAGE_LIMIT];
+
+ipc_ring_t *create_ring() {
+    static unsigned int rings_created = 0;
+    char name[64];
+    int memory_file_descriptor;
+
+    /* Unlinked straight away, the descriptor is the only way in */
+    snprintf(name, sizeof(name), "/custard.%d.%u", (int)getpid(),
+        rings_created++);
+    memory_file_descriptor = shm_open(name, O_RDWR | O_CREAT | O_EXCL,
+        0600);
+    if (memory_file_descriptor < 0) {
+        log_message("Unable to create ring: %s", strerror(errno));
+        return NULL;
+    }
+    shm_unlink(name);
+
+    if (ftruncate(memory_file_descriptor, sizeof(ipc_ring_memory_t)) < 0) {
+        log_message("Unable to size ring: %s", strerror(errno));
+        close(memory_file_descriptor);
+        return NULL;
+    }
+
+    /* The controller blocks on this while the ring is full */
+    int space_file_descriptor = eventfd(0, EFD_CLOEXEC);
+    ipc_ring_t *ring = attach_ring(memory_file_descriptor, -1,
+        space_file_descriptor);
+
+    if (!ring) {
+        close(memory_file_descriptor);
+        if (space_file_descriptor >= 0)
+            close(space_file_descriptor);
+    }
+
+    return ring;
+}
+
+ipc_ring_t *attach_ring(int memory_file_descriptor, int wakeup_file_descriptor,
+    int space_file_descriptor) {
+    if (space_file_descriptor < 0)
+        return NULL;
+
+    void *memory = mmap(NULL, sizeof(ipc_ring_memory_t),
+        PROT_READ | PROT_WRITE, MAP_SHARED, memory_file_descriptor, 0);
+    if (memory == MAP_FAILED) {
+        log_message("Unable to map ring: %s", strerror(errno));
+        return NULL;
+    }
+
+    ipc_ring_t *ring = (ipc_ring_t*)calloc(1, sizeof(ipc_ring_t));
+    ring->memory = (ipc_ring_memory_t*)memory;
+    ring->memory_file_descriptor = memory_file_descriptor;
+    ring->wakeup_file_descriptor = wakeup_file_descriptor;
+    ring->space_file_descriptor = space_file_descriptor;
+
+    return ring;
+}
+
+void destroy_ring(ipc_ring_t *ring) {
+    munmap(ring->memory, sizeof(ipc_ring_memory_t));
+
+    if (ring->memory_file_descriptor >= 0)
+        close(ring->memory_file_descriptor);
+    if (ring->wakeup_file_descriptor >= 0)
+        close(ring->wakeup_file_descriptor);
+    close(ring->space_file_descriptor);
+
+    free(ring);
+}
+
+static void signal_descriptor(int file_descriptor) {
+    uint64_t count = 1;
+
+    while (write(file_descriptor, &count, sizeof(count)) < 0 &&
+        errno == EINTR);
+}
+
+static void copy_into_ring(ipc_ring_memory_t *memory, uint32_t offset,
+    const char *source, unsigned int length) {
+    unsigned int index = offset & (IPC_RING_SIZE - 1);
+    unsigned int first = IPC_RING_SIZE - index;
+
+    if (first > length)
+        first = length;
+
+    memcpy(memory->data + index, source, first);
+    memcpy(memory->data, source + first, length - first);
+}
+
+static void copy_from_ring(ipc_ring_memory_t *memory, uint32_t offset,
+    char *destination, unsigned int length) {
+    unsigned int index = offset & (IPC_RING_SIZE - 1);
+    unsigned int first = IPC_RING_SIZE - index;
+
+    if (first > length)
+        first = length;
+
+    memcpy(destination, memory->data + index, first);
+    memcpy(destination + first, memory->data, length - first);
+}
+
+static unsigned short wait_for_space(ipc_ring_t *ring, uint32_t head,
+    unsigned int length) {
+    ipc_ring_memory_t *memory = ring->memory;
+    uint64_t count;
+    struct pollfd descriptors[2] = {
+        { ring->space_file_descriptor, POLLIN, 0 },
+        { socket_file_descriptor, 0, 0 }
+    };
+
+    for (;;) {
+        atomic_store(&memory->waiting, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        if (IPC_RING_SIZE - (head - atomic_load_explicit(&memory->tail,
+            memory_order_acquire)) >= length)
+            break;
+
+        /* The socket hanging up means nobody will ever make room */
+        if (poll(descriptors, 2, -1) < 0 && errno != EINTR)
+            return 0;
+        if (descriptors[1].revents & (POLLHUP | POLLERR))
+            return 0;
+        if (descriptors[0].revents & POLLIN)
+            while (read(ring->space_file_descriptor, &count,
+                sizeof(count)) < 0 && errno == EINTR);
+    }
+
+    atomic_store_explicit(&memory->waiting, 0, memory_order_relaxed);
+
+    return 1;
+}
+
+unsigned short push_to_ring(ipc_ring_t *ring, char *payload,
+    unsigned int length) {
+    ipc_ring_memory_t *memory = ring->memory;
+    char header[IPC_HEADER_SIZE];
+
+    if (length > IPC_RING_MESSAGE_LIMIT)
+        return 0;
+
+    uint32_t head = atomic_load_explicit(&memory->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&memory->tail, memory_order_acquire);
+
+    if (IPC_RING_SIZE - (head - tail) < IPC_HEADER_SIZE + length &&
+        !wait_for_space(ring, head, IPC_HEADER_SIZE + length))
+        return 0;
+
+    write_message_header(header, length);
+    copy_into_ring(memory, head, header, IPC_HEADER_SIZE);
+    copy_into_ring(memory, head + IPC_HEADER_SIZE, payload, length);
+
+    atomic_store_explicit(&memory->head, head + IPC_HEADER_SIZE + length,
+        memory_order_release);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    /* Only a consumer that had caught up can be asleep */
+    if (atomic_load_explicit(&memory->tail, memory_order_relaxed) == head)
+        signal_descriptor(ring->wakeup_file_descriptor);
+
+    return 1;
+}
+
+char *pull_from_ring(ipc_ring_t *ring, unsigned int *length) {
+    ipc_ring_memory_t *memory = ring->memory;
+    char header[IPC_HEADER_SIZE];
+
+    uint32_t tail = atomic_load_explicit(&memory->tail, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    uint32_t head = atomic_load_explicit(&memory->head, memory_order_acquire);
+
+    if (head == tail || ring->broken)
+        return NULL;
+
+    /*
+     * The record is copied out before tail moves on, so nothing the
+     * controller writes afterwards can change a command being handled.
+     */
+    if (head - tail < IPC_HEADER_SIZE) {
+        ring->broken = 1;
+        return NULL;
+    }
+
+    copy_from_ring(memory, tail, header, IPC_HEADER_SIZE);
+    *length = read_message_header(header);
+
+    if (*length > IPC_RING_MESSAGE_LIMIT ||
+        head - tail - IPC_HEADER_SIZE < *length) {
+        log_message("Ring holds a malformed command, dropping it");
+        ring->broken = 1;
+        return NULL;
+    }
+
+    copy_from_ring(memory, tail + IPC_HEADER_SIZE, ring_message, *length);
+
+    atomic_store_explicit(&memory->tail, tail + IPC_HEADER_SIZE + *length,
+        memory_order_release);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (atomic_load_explicit(&memory->waiting, memory_order_relaxed))
+        signal_descriptor(ring->space_file_descriptor);
+
+    return ring_message;
+}
+
+unsigned short ring_is_empty(ipc_ring_t *ring) {
+    atomic_thread_fence(memory_order_seq_cst);
+
+    return ring->broken || atomic_load(&ring->memory->head) ==
+        atomic_load(&ring->memory->tail);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "protocol.h"
+
+/* Bytes of command data a ring holds, a power of two */
+#define IPC_RING_SIZE (1 << 20)
+
+/* Commands taken from one ring per wakeup before X gets its turn */
+#define IPC_RING_BATCH 256
+
+/* Commands are copied out of the ring whole, longer ones use the socket */
+#define IPC_RING_MESSAGE_LIMIT 65536
+
+/*
+ * Shared between one controller, the only producer, and the window
+ * manager, the only consumer. Records use the socket framing: a length
+ * header followed by the tokens. head and tail run freely and are
+ * reduced modulo IPC_RING_SIZE when indexing data.
+ */
+typedef struct {
+    atomic_uint head;
+    char head_padding[60];
+    atomic_uint tail;
+    atomic_uint waiting;
+    char tail_padding[56];
+    char data[IPC_RING_SIZE];
+} ipc_ring_memory_t;
+
+typedef struct {
+    ipc_ring_memory_t *memory;
+    int memory_file_descriptor;
+    int wakeup_file_descriptor;
+    int space_file_descriptor;
+    unsigned short broken;
+} ipc_ring_t;
+
+ipc_ring_t *create_ring(void);
+ipc_ring_t *attach_ring(int, int, int);
+void destroy_ring(ipc_ring_t*);
+
+unsigned short push_to_ring(ipc_ring_t*, char*, unsigned int);
+char *pull_from_ring(ipc_ring_t*, unsigned int*);
+unsigned short ring_is_empty(ipc_ring_t*);
@@ -1,18 +1,28 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <sys/un.h>
+#include <sys/uio.h>
 #include <sys/socket.h>
 
 #include "socket.h"
 
-#include "../wm/custard.h"
+#include "../log.h"
 
 int socket_file_descriptor;
+int ring_file_descriptor = -1;
 socket_mode_t socket_mode;
 char *socket_path;
 
+vector_t *ipc_connections = NULL;
+ipc_connection_t *command_connection = NULL;
+unsigned short accepting_connections = 1;
+
 unsigned short initialize_socket() {
     struct sockaddr_un address;
 
@@ -27,9 +37,14 @@ unsigned short initialize_socket() {
     sprintf(socket_path, "/tmp/custard.%s_%s.sock", user, display);
     snprintf(address.sun_path, sizeof(address.sun_path), "%s", socket_path);
 
-    socket_file_descriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+    /* The window manager never waits on a client */
+    if (socket_mode == WINDOW_MANAGER)
+        socket_file_descriptor = socket(AF_UNIX,
+            SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    else
+        socket_file_descriptor = socket(AF_UNIX, SOCK_STREAM, 0);
 
-    if (!socket_file_descriptor) {
+    if (socket_file_descriptor < 0) {
         log_fatal("Unable to open socket");
         return 0;
     }
@@ -41,10 +56,17 @@ unsigned short initialize_socket() {
             return 0;
         }
 
-        if (listen(socket_file_descriptor, 1) < 0) {
+        if (listen(socket_file_descriptor, SOMAXCONN) < 0) {
             log_fatal("Unable to listen to socket");
             return 0;
         }
+
+        ipc_connections = construct_vector();
+
+        /* Shared by every ring, a controller writes it to wake the loop */
+        ring_file_descriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (ring_file_descriptor < 0)
+            log_message("Unable to create ring eventfd, rings unavailable");
     } else if (socket_mode == CONTROLLER) {
         if (connect(socket_file_descriptor, (struct sockaddr*)&address,
             sizeof(address)) < 0) {
@@ -57,32 +79,516 @@ unsigned short initialize_socket() {
 }
 
 void finalize_socket() {
+    if (ipc_connections) {
+        while (ipc_connections->size)
+            close_connection(ipc_connections->size - 1);
+        deconstruct_vector(ipc_connections);
+        ipc_connections = NULL;
+    }
+
     if (socket_mode == WINDOW_MANAGER)
         unlink(socket_path);
-    else
-        close(socket_file_descriptor);
+
+    if (ring_file_descriptor >= 0)
+        close(ring_file_descriptor);
+
+    close(socket_file_descriptor);
     free(socket_path);
 }
 
-void write_to_socket(char *input) {
-    log_debug("Feeding data to socket(%s)", input);
+unsigned short write_to_socket(char *payload, unsigned int length) {
+    char header[IPC_HEADER_SIZE];
+    struct iovec vectors[2] = {
+        { header, IPC_HEADER_SIZE },
+        { payload, length }
+    };
+    unsigned int vector = 0;
+    ssize_t written;
+
+    write_message_header(header, length);
+
+    /* Header and payload leave in one write unless the socket is full */
+    while (vector < 2) {
+        written = writev(socket_file_descriptor, vectors + vector, 2 - vector);
+
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written < 0) {
+            log_message("Unable to write to socket: %s", strerror(errno));
+            return 0;
+        }
+
+        for (; vector < 2 && (size_t)written >= vectors[vector].iov_len;
+            vector++)
+            written -= vectors[vector].iov_len;
+
+        if (vector < 2) {
+            vectors[vector].iov_base = (char*)vectors[vector].iov_base +
+                written;
+            vectors[vector].iov_len -= written;
+        }
+    }
+
+    return 1;
+}
+
+static unsigned short read_exactly(char *buffer, unsigned int length) {
+    ssize_t received;
+
+    while (length) {
+        received = read(socket_file_descriptor, buffer, length);
+
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return 0;
+
+        buffer += received;
+        length -= received;
+    }
 
-    write(socket_file_descriptor, input, strlen(input));
+    return 1;
 }
 
-char *read_from_socket() {
-    int command_file_descriptor = accept(socket_file_descriptor, NULL, 0);
+unsigned short read_response_from_socket() {
+    char header[IPC_HEADER_SIZE];
+    char buffer[1024];
+    uint32_t length;
+    unsigned int chunk;
+
+    if (!read_exactly(header, IPC_HEADER_SIZE))
+        return 0;
+
+    /* Streamed through a fixed buffer whatever the response size */
+    length = read_message_header(header);
+    while (length) {
+        chunk = length < sizeof(buffer) ? length : sizeof(buffer);
+        if (!read_exactly(buffer, chunk))
+            return 0;
 
-    if (!command_file_descriptor) {
-        log_fatal("Unable to accept connection to socket");
-        return "";
+        fwrite(buffer, sizeof(char), chunk, stdout);
+        length -= chunk;
     }
 
-    char *output = calloc(1024, sizeof(char));
-    ssize_t length = read(command_file_descriptor, output, 1023);
+    return 1;
+}
+
+ipc_ring_t *request_ring() {
+    char command[] = "ring";
+    char header[IPC_HEADER_SIZE];
+    char discard[64];
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int) * 3)];
+    } control;
+    struct iovec vector = { header, IPC_HEADER_SIZE };
+    struct msghdr message;
+    struct cmsghdr *control_header;
+    int descriptors[3];
+    unsigned int count = 0;
+    uint32_t length;
+    ssize_t received;
+
+    if (!write_to_socket(command, sizeof(command)))
+        return NULL;
+
+    /* The descriptors arrive with the first bytes of the response */
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    while ((received = recvmsg(socket_file_descriptor, &message, 0)) < 0 &&
+        errno == EINTR);
+    if (received <= 0)
+        return NULL;
+
+    for (control_header = CMSG_FIRSTHDR(&message); control_header;
+        control_header = CMSG_NXTHDR(&message, control_header)) {
+        if (control_header->cmsg_level != SOL_SOCKET ||
+            control_header->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        count = (control_header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        if (count > 3)
+            count = 3;
+        memcpy(descriptors, CMSG_DATA(control_header), sizeof(int) * count);
+    }
+
+    if (!read_exactly(header + received, IPC_HEADER_SIZE - received))
+        count = 0;
+
+    for (length = read_message_header(header); count && length;) {
+        received = length < sizeof(discard) ? length : sizeof(discard);
+        if (!read_exactly(discard, received))
+            count = 0;
+        length -= received;
+    }
+
+    if (count == 3) {
+        ipc_ring_t *ring = attach_ring(descriptors[0], descriptors[1],
+            descriptors[2]);
+        if (ring)
+            return ring;
+    }
+
+    log_fatal("Window manager did not offer a ring");
+    while (count)
+        close(descriptors[--count]);
+
+    return NULL;
+}
+
+void accept_connections() {
+    int file_descriptor;
+    ipc_connection_t *connection;
+
+    while ((file_descriptor = accept(socket_file_descriptor, NULL,
+        NULL)) >= 0) {
+        fcntl(file_descriptor, F_SETFL,
+            fcntl(file_descriptor, F_GETFL) | O_NONBLOCK);
+        fcntl(file_descriptor, F_SETFD, FD_CLOEXEC);
+
+        connection = (ipc_connection_t*)calloc(1, sizeof(ipc_connection_t));
+        connection->file_descriptor = file_descriptor;
+        connection->state = CONNECTION_READING;
+
+        push_to_vector(ipc_connections, connection);
+    }
+
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        return;
+
+    /*
+     * The pending connection stays queued and the listener readable, so
+     * it is left out of the poll set rather than retried on every pass.
+     */
+    if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS ||
+        errno == ENOMEM) {
+        accepting_connections = 0;
+        log_message("Unable to accept connection to socket: %s, paused",
+            strerror(errno));
+        return;
+    }
+
+    log_message("Unable to accept connection to socket: %s",
+        strerror(errno));
+}
+
+void resume_accepting_connections() {
+    if (!accepting_connections)
+        log_debug("Accepting connections again");
+
+    accepting_connections = 1;
+}
+
+/* Sent in place of a response that could not be held in memory */
+static char response_failure[] = "error\tmessage=response too large\n";
+
+static unsigned short reserve_buffer(char **buffer, unsigned int *memory,
+    unsigned int length) {
+    if (length <= *memory)
+        return 1;
+
+    unsigned int size = *memory ? *memory : 256;
+    while (size < length)
+        size = size > UINT_MAX / 2 ? UINT_MAX : size * 2;
+
+    char *resized = realloc(*buffer, size);
+    if (!resized)
+        return 0;
+
+    *buffer = resized;
+    *memory = size;
+
+    return 1;
+}
+
+static unsigned short holds_complete_message(ipc_connection_t *connection) {
+    if (connection->input_length < IPC_HEADER_SIZE)
+        return 0;
+
+    return connection->input_length - IPC_HEADER_SIZE >=
+        read_message_header(connection->input);
+}
+
+void read_from_connection(ipc_connection_t *connection) {
+    ssize_t length;
+
+    /* Messages already handled are dropped from the front of the buffer */
+    if (connection->input_parsed) {
+        memmove(connection->input,
+            connection->input + connection->input_parsed,
+            connection->input_length - connection->input_parsed);
+        connection->input_length -= connection->input_parsed;
+        connection->input_parsed = 0;
+    }
+
+    for (;;) {
+        /*
+         * The buffer grows to whatever the first message needs, the
+         * client waits once a command and some read-ahead are in.
+         */
+        if (connection->input_length >= IPC_READ_AHEAD &&
+            holds_complete_message(connection))
+            return;
+
+        if (connection->input_length > UINT_MAX - 512 ||
+            !reserve_buffer(&connection->input, &connection->input_memory,
+            connection->input_length + 512)) {
+            log_message("Unable to buffer command, dropping connection");
+            connection->state = CONNECTION_CLOSED;
+            return;
+        }
+
+        length = read(connection->file_descriptor,
+            connection->input + connection->input_length,
+            connection->input_memory - connection->input_length);
+
+        if (length > 0) {
+            connection->input_length += length;
+            continue;
+        }
+
+        if (!length) {
+            connection->closing = 1;
+            return;
+        }
+
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            connection->state = CONNECTION_CLOSED;
+
+        return;
+    }
+}
+
+char *next_message(ipc_connection_t *connection, unsigned int *length) {
+    char *message = connection->input + connection->input_parsed;
+    unsigned int available = connection->input_length -
+        connection->input_parsed;
+
+    if (available < IPC_HEADER_SIZE)
+        return NULL;
+
+    *length = read_message_header(message);
+    if (*length > UINT_MAX - IPC_HEADER_SIZE) {
+        log_message("Command of %u bytes refused", *length);
+        connection->state = CONNECTION_CLOSED;
+        return NULL;
+    }
+
+    if (available - IPC_HEADER_SIZE < *length)
+        return NULL;
+
+    connection->input_parsed += IPC_HEADER_SIZE + *length;
+
+    return message + IPC_HEADER_SIZE;
+}
+
+void start_command(ipc_connection_t *connection) {
+    command_connection = connection;
+
+    /*
+     * The header is filled in once the response is complete. Room for a
+     * failure is set aside now so a command can always be answered.
+     */
+    connection->response_start = connection->output_length;
+    connection->response_failed = !reserve_buffer(&connection->output,
+        &connection->output_memory, connection->output_length +
+        IPC_HEADER_SIZE + sizeof(response_failure));
+    if (connection->response_failed) {
+        connection->state = CONNECTION_CLOSED;
+        return;
+    }
+
+    connection->output_length += IPC_HEADER_SIZE;
+}
+
+static char *extend_response(unsigned long length) {
+    if (!command_connection || command_connection->response_failed)
+        return NULL;
+
+    ipc_connection_t *connection = command_connection;
+
+    /* A response is sent whole or not at all */
+    if (length > UINT_MAX || connection->output_length > UINT_MAX - length ||
+        !reserve_buffer(&connection->output, &connection->output_memory,
+        connection->output_length + length)) {
+        log_message("Unable to buffer response, sending an error instead");
+        connection->response_failed = 1;
+        return NULL;
+    }
+
+    connection->output_length += length;
+
+    return connection->output + connection->output_length - length;
+}
+
+void respond_to_command(char *response) {
+    unsigned int length = strlen(response);
+    char *destination = extend_response(length);
+
+    if (destination)
+        memcpy(destination, response, length);
+}
+
+void respond_escaped(char *value) {
+    unsigned long length = 0;
+    char *destination;
+
+    for (char *character = value; *character; character++)
+        length += *character == '\t' || *character == '\n' ||
+            *character == '\\' ? 2 : 1;
+
+    if (!(destination = extend_response(length)))
+        return;
+
+    /* Records stay one per line and fields stay split on tabs */
+    for (char *character = value; *character; character++) {
+        if (*character == '\t' || *character == '\n' || *character == '\\') {
+            *destination++ = '\\';
+            *destination++ = *character == '\t' ? 't' :
+                *character == '\n' ? 'n' : '\\';
+        } else
+            *destination++ = *character;
+    }
+}
+
+void finish_command(ipc_connection_t *connection) {
+    command_connection = NULL;
+
+    if (connection->state == CONNECTION_CLOSED)
+        return;
+
+    if (connection->response_failed) {
+        connection->output_length = connection->response_start +
+            IPC_HEADER_SIZE;
+        memcpy(connection->output + connection->output_length,
+            response_failure, sizeof(response_failure) - 1);
+        connection->output_length += sizeof(response_failure) - 1;
+        connection->response_failed = 0;
+    }
+
+    /* Every command is answered, if only with an empty response */
+    write_message_header(connection->output + connection->response_start,
+        connection->output_length - connection->response_start -
+        IPC_HEADER_SIZE);
+
+    write_to_connection(connection);
+}
+
+static ssize_t send_with_descriptors(ipc_connection_t *connection) {
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int) * 3)];
+    } control;
+    struct iovec vector = {
+        connection->output + connection->output_sent,
+        connection->output_length - connection->output_sent
+    };
+    struct msghdr message;
+    struct cmsghdr *control_header;
+    ssize_t length;
+
+    memset(&message, 0, sizeof(message));
+    memset(&control, 0, sizeof(control));
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = CMSG_SPACE(sizeof(int) *
+        connection->descriptor_count);
+
+    control_header = CMSG_FIRSTHDR(&message);
+    control_header->cmsg_level = SOL_SOCKET;
+    control_header->cmsg_type = SCM_RIGHTS;
+    control_header->cmsg_len = CMSG_LEN(sizeof(int) *
+        connection->descriptor_count);
+    memcpy(CMSG_DATA(control_header), connection->descriptors,
+        sizeof(int) * connection->descriptor_count);
+
+    length = sendmsg(connection->file_descriptor, &message, MSG_NOSIGNAL);
+
+    /* The client has its own copy of the ring memory now */
+    if (length > 0) {
+        connection->descriptor_count = 0;
+        close(connection->ring->memory_file_descriptor);
+        connection->ring->memory_file_descriptor = -1;
+    }
+
+    return length;
+}
+
+void write_to_connection(ipc_connection_t *connection) {
+    ssize_t length;
+
+    while (connection->output_sent < connection->output_length) {
+        /* A client that went away must not take SIGPIPE down with it */
+        if (connection->descriptor_count)
+            length = send_with_descriptors(connection);
+        else
+            length = send(connection->file_descriptor,
+                connection->output + connection->output_sent,
+                connection->output_length - connection->output_sent,
+                MSG_NOSIGNAL);
+
+        if (length > 0) {
+            connection->output_sent += length;
+            continue;
+        }
+
+        if (length < 0 && errno == EINTR)
+            continue;
+
+        /* Further commands wait until the client takes the response */
+        if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            connection->state = CONNECTION_WRITING;
+            return;
+        }
+
+        connection->state = CONNECTION_CLOSED;
+        return;
+    }
+
+    connection->output_length = 0;
+    connection->output_sent = 0;
+    connection->state = CONNECTION_READING;
+}
+
+unsigned short offer_ring(ipc_connection_t *connection) {
+    if (connection->ring || ring_file_descriptor < 0)
+        return 0;
+
+    if (!(connection->ring = create_ring()))
+        return 0;
+
+    /* Sent along with the response to the command asking for it */
+    connection->descriptors[0] = connection->ring->memory_file_descriptor;
+    connection->descriptors[1] = ring_file_descriptor;
+    connection->descriptors[2] = connection->ring->space_file_descriptor;
+    connection->descriptor_count = 3;
+
+    return 1;
+}
+
+void close_connection(unsigned int index) {
+    ipc_connection_t *connection = get_from_vector(ipc_connections, index);
+    if (!connection)
+        return;
+
+    if (command_connection == connection)
+        command_connection = NULL;
+
+    if (connection->ring)
+        destroy_ring(connection->ring);
 
-    output[length] = '\0';
-    log_debug("Fed data(%s)", output);
+    close(connection->file_descriptor);
+    resume_accepting_connections();
+    free(connection->input);
+    free(connection->output);
+    free(connection);
 
-    return output;
+    pull_from_vector(ipc_connections, index);
 }
@@ -1,15 +1,62 @@
 #pragma once
 
+#include "protocol.h"
+#include "ring.h"
+
+#include "../vector.h"
+
 typedef enum {
     WINDOW_MANAGER = 0,
     CONTROLLER = 1
 } socket_mode_t;
 
+typedef enum {
+    CONNECTION_READING = 0,
+    CONNECTION_WRITING,
+    CONNECTION_CLOSED
+} connection_state_t;
+
+typedef struct {
+    int file_descriptor;
+    connection_state_t state;
+    unsigned short closing;
+    char *input;
+    unsigned int input_length;
+    unsigned int input_memory;
+    unsigned int input_parsed;
+    char *output;
+    unsigned int output_length;
+    unsigned int output_memory;
+    unsigned int output_sent;
+    unsigned int response_start;
+    unsigned short response_failed;
+    ipc_ring_t *ring;
+    int descriptors[3];
+    unsigned int descriptor_count;
+} ipc_connection_t;
+
 extern int socket_file_descriptor;
+extern int ring_file_descriptor;
 extern socket_mode_t socket_mode;
+extern vector_t *ipc_connections;
+extern ipc_connection_t *command_connection;
+extern unsigned short accepting_connections;
 
 unsigned short initialize_socket(void);
 void finalize_socket(void);
 
-void write_to_socket(char*);
-char* read_from_socket(void);
+unsigned short write_to_socket(char*, unsigned int);
+unsigned short read_response_from_socket(void);
+ipc_ring_t *request_ring(void);
+
+void accept_connections(void);
+void resume_accepting_connections(void);
+void read_from_connection(ipc_connection_t*);
+char *next_message(ipc_connection_t*, unsigned int*);
+void start_command(ipc_connection_t*);
+void respond_to_command(char*);
+void respond_escaped(char*);
+void finish_command(ipc_connection_t*);
+void write_to_connection(ipc_connection_t*);
+unsigned short offer_ring(ipc_connection_t*);
+void close_connection(unsigned int);
@@ -0,0 +1,35 @@
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "log.h"
+
+unsigned short loglevel = 1;
+
+void _log(unsigned short level, const char *file, const char *function,
+    const int line, char *formatting, ...) {
+
+    /*
+     * Loglevels:
+     * 0 - Absolutely fucking nothing
+     * 1 - Fatal
+     * 2 - Message
+     * 3 - Debug
+     */
+
+     if (loglevel < level)
+        return;
+
+    /* The watchdog thread logs too; a line is written as one piece */
+    flockfile(stderr);
+
+    fprintf(stderr, "%s:%s L%d: ", file, function, line);
+
+    va_list ap;
+    va_start(ap, formatting);
+    vfprintf(stderr, formatting, ap);
+    va_end(ap);
+
+    fputs("\n", stderr);
+
+    funlockfile(stderr);
+}
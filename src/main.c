@@ -7,7 +7,7 @@
 
 int main(int argc, char** argv) {
     if (should_become_controller(argc, argv))
-        return controller(argc, argv);
+        return controller(argc - 2, argv + 2);
 
     return custard(argc, argv);
 }
@@ -0,0 +1,133 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "table.h"
+
+/*
+ * Open addressing with linear probing, keyed by non-zero integers (X
+ * resource ids). Key 0 marks an empty slot.
+ */
+
+static unsigned int hash_key(unsigned int key) {
+    key ^= key >> 16;
+    key *= 0x45d9f3b;
+    key ^= key >> 16;
+
+    return key;
+}
+
+static void grow_table(table_t *table) {
+    table_entry_t *entries = table->entries;
+    unsigned int memory = table->memory;
+
+    table->memory *= 2;
+    table->size = 0;
+    table->entries = calloc(table->memory, sizeof(table_entry_t));
+
+    for (unsigned int index = 0; index < memory; index++)
+        if (entries[index].key)
+            insert_into_table(table, entries[index].key, entries[index].value);
+
+    free(entries);
+}
+
+table_t *construct_table() {
+    table_t *table = (table_t*)calloc(1, sizeof(table_t));
+    table->memory = 16;
+    table->size = 0;
+    table->entries = calloc(table->memory, sizeof(table_entry_t));
+
+    return table;
+}
+
+void insert_into_table(table_t *table, unsigned int key, void *value) {
+    if (!key)
+        return;
+
+    if ((table->size + 1) * 4 > table->memory * 3)
+        grow_table(table);
+
+    unsigned int mask = table->memory - 1;
+    unsigned int index = hash_key(key) & mask;
+
+    while (table->entries[index].key && table->entries[index].key != key)
+        index = (index + 1) & mask;
+
+    if (!table->entries[index].key)
+        table->size++;
+
+    table->entries[index].key = key;
+    table->entries[index].value = value;
+}
+
+void reserve_table(table_t *table, unsigned int size) {
+    /* Room for size keys without crossing the load factor */
+    while (size * 4 > table->memory * 3)
+        grow_table(table);
+}
+
+void *get_from_table(table_t *table, unsigned int key) {
+    if (!key)
+        return NULL;
+
+    unsigned int mask = table->memory - 1;
+    unsigned int index = hash_key(key) & mask;
+
+    while (table->entries[index].key) {
+        if (table->entries[index].key == key)
+            return table->entries[index].value;
+
+        index = (index + 1) & mask;
+    }
+
+    return NULL;
+}
+
+void *pull_from_table(table_t *table, unsigned int key) {
+    if (!key)
+        return NULL;
+
+    unsigned int mask = table->memory - 1;
+    unsigned int index = hash_key(key) & mask;
+
+    while (table->entries[index].key && table->entries[index].key != key)
+        index = (index + 1) & mask;
+
+    if (!table->entries[index].key)
+        return NULL;
+
+    void *value = table->entries[index].value;
+    table->entries[index].key = 0;
+    table->entries[index].value = NULL;
+    table->size--;
+
+    /* Shift the rest of the cluster back so probes stay unbroken */
+
+    unsigned int next = (index + 1) & mask;
+    unsigned int home;
+
+    while (table->entries[next].key) {
+        home = hash_key(table->entries[next].key) & mask;
+
+        if (((next - home) & mask) >= ((next - index) & mask)) {
+            table->entries[index] = table->entries[next];
+            table->entries[next].key = 0;
+            table->entries[next].value = NULL;
+            index = next;
+        }
+
+        next = (next + 1) & mask;
+    }
+
+    return value;
+}
+
+void clear_table(table_t *table) {
+    memset(table->entries, 0, table->memory * sizeof(table_entry_t));
+    table->size = 0;
+}
+
+void deconstruct_table(table_t *table) {
+    free(table->entries);
+    free(table);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+typedef struct {
+    unsigned int key;
+    void *value;
+} table_entry_t;
+
+typedef struct {
+    table_entry_t *entries;
+    unsigned int memory;
+    unsigned int size;
+} table_t;
+
+table_t *construct_table(void);
+void insert_into_table(table_t*, unsigned int, void*);
+void reserve_table(table_t*, unsigned int);
+void *get_from_table(table_t*, unsigned int);
+void *pull_from_table(table_t*, unsigned int);
+void clear_table(table_t*);
+void deconstruct_table(table_t*);
@@ -0,0 +1,192 @@
+#include <stdlib.h>
+
+#include "timer.h"
+
+/*
+ * Binary min-heap ordered by expiry. The event loop sleeps until the
+ * earliest timer, or indefinitely when there is none.
+ */
+
+static timer_entry_t **timers = NULL;
+static unsigned int timer_memory = 0;
+static unsigned int timer_count = 0;
+static unsigned int next_timer_id = 1;
+
+static unsigned int running_timer = 0;
+static unsigned short running_timer_cancelled = 0;
+
+static int compare_expiry(struct timespec *a, struct timespec *b) {
+    if (a->tv_sec != b->tv_sec)
+        return a->tv_sec < b->tv_sec ? -1 : 1;
+    if (a->tv_nsec != b->tv_nsec)
+        return a->tv_nsec < b->tv_nsec ? -1 : 1;
+
+    return 0;
+}
+
+static void add_microseconds(struct timespec *time, unsigned long delay) {
+    time->tv_sec += delay / 1000000;
+    time->tv_nsec += (delay % 1000000) * 1000;
+
+    if (time->tv_nsec >= 1000000000L) {
+        time->tv_sec++;
+        time->tv_nsec -= 1000000000L;
+    }
+}
+
+static void swap_timers(unsigned int a, unsigned int b) {
+    timer_entry_t *timer = timers[a];
+    timers[a] = timers[b];
+    timers[b] = timer;
+}
+
+static void sift_up(unsigned int index) {
+    unsigned int parent;
+
+    while (index) {
+        parent = (index - 1) / 2;
+        if (compare_expiry(&timers[index]->expiry,
+            &timers[parent]->expiry) >= 0)
+            break;
+
+        swap_timers(index, parent);
+        index = parent;
+    }
+}
+
+static void sift_down(unsigned int index) {
+    unsigned int child, smallest;
+
+    for (;;) {
+        smallest = index;
+
+        for (child = index * 2 + 1; child <= index * 2 + 2; child++)
+            if (child < timer_count && compare_expiry(&timers[child]->expiry,
+                &timers[smallest]->expiry) < 0)
+                smallest = child;
+
+        if (smallest == index)
+            break;
+
+        swap_timers(index, smallest);
+        index = smallest;
+    }
+}
+
+static void push_timer(timer_entry_t *timer) {
+    if (timer_count == timer_memory) {
+        timer_memory = timer_memory ? timer_memory * 2 : 8;
+        timers = realloc(timers, timer_memory * sizeof(timer_entry_t*));
+    }
+
+    timers[timer_count] = timer;
+    sift_up(timer_count++);
+}
+
+static timer_entry_t *remove_timer(unsigned int index) {
+    timer_entry_t *timer = timers[index];
+
+    timers[index] = timers[--timer_count];
+    if (index < timer_count) {
+        sift_down(index);
+        sift_up(index);
+    }
+
+    return timer;
+}
+
+unsigned int add_timer(unsigned long delay, unsigned long interval,
+    void (*callback)(void*), void *data) {
+    timer_entry_t *timer = (timer_entry_t*)calloc(1, sizeof(timer_entry_t));
+
+    timer->id = next_timer_id++;
+    if (!next_timer_id)
+        next_timer_id = 1;
+
+    timer->interval = interval;
+    timer->callback = callback;
+    timer->data = data;
+
+    clock_gettime(CLOCK_MONOTONIC, &timer->expiry);
+    add_microseconds(&timer->expiry, delay);
+
+    push_timer(timer);
+
+    return timer->id;
+}
+
+unsigned int defer(void (*callback)(void*), void *data) {
+    /* Runs on the next pass of the event loop */
+    return add_timer(0, 0, callback, data);
+}
+
+void cancel_timer(unsigned int id) {
+    if (id && id == running_timer) {
+        running_timer_cancelled = 1;
+        return;
+    }
+
+    for (unsigned int index = 0; index < timer_count; index++) {
+        if (timers[index]->id == id) {
+            free(remove_timer(index));
+            return;
+        }
+    }
+}
+
+int timer_timeout() {
+    if (!timer_count)
+        return -1;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if (compare_expiry(&timers[0]->expiry, &now) <= 0)
+        return 0;
+
+    long milliseconds = (timers[0]->expiry.tv_sec - now.tv_sec) * 1000 +
+        (timers[0]->expiry.tv_nsec - now.tv_nsec + 999999) / 1000000;
+
+    return milliseconds > 0 ? (int)milliseconds : 0;
+}
+
+unsigned int run_timers() {
+    if (!timer_count)
+        return 0;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    unsigned int due = 0;
+    timer_entry_t *timer;
+
+    /* Strictly before now, so timers added by callbacks wait for the
+     * next pass rather than running in this one */
+    while (timer_count && compare_expiry(&timers[0]->expiry, &now) < 0) {
+        timer = remove_timer(0);
+
+        running_timer = timer->id;
+        running_timer_cancelled = 0;
+        timer->callback(timer->data);
+        running_timer = 0;
+        due++;
+
+        if (timer->interval && !running_timer_cancelled) {
+            /* Skip missed intervals instead of running them back to back */
+            timer->expiry = now;
+            add_microseconds(&timer->expiry, timer->interval);
+            push_timer(timer);
+        } else free(timer);
+    }
+
+    return due;
+}
+
+void finalize_timers() {
+    for (unsigned int index = 0; index < timer_count; index++)
+        free(timers[index]);
+
+    free(timers);
+    timers = NULL;
+    timer_count = timer_memory = 0;
+}
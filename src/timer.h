@@ -0,0 +1,18 @@
+#pragma once
+
+#include <time.h>
+
+typedef struct {
+    unsigned int id;
+    struct timespec expiry;
+    unsigned long interval; /* microseconds, 0 for one-shot timers */
+    void (*callback)(void*);
+    void *data;
+} timer_entry_t;
+
+unsigned int add_timer(unsigned long, unsigned long, void (*)(void*), void*);
+unsigned int defer(void (*)(void*), void*);
+void cancel_timer(unsigned int);
+int timer_timeout(void);
+unsigned int run_timers(void);
+void finalize_timers(void);
@@ -64,6 +64,28 @@ void *get_from_vector(vector_t *vector, unsigned int index) {
     return vector->elements[index];
 }
 
+void reserve_vector(vector_t *vector, unsigned int memory) {
+    if (memory <= vector->memory)
+        return;
+
+    vector->memory = memory;
+    vector->elements = realloc(vector->elements,
+        sizeof(void*) * (vector->memory + 1));
+}
+
+void truncate_vector(vector_t *vector, unsigned int size) {
+    if (size >= vector->size)
+        return;
+
+    vector->size = size;
+    vector->remaining = size;
+}
+
+void clear_vector(vector_t *vector) {
+    vector->size = 0;
+    vector->remaining = 0;
+}
+
 void deconstruct_vector(vector_t *vector) {
     free(vector->elements);
     free(vector);
@@ -13,4 +13,7 @@ void reset_vector_iterator(vector_t*);
 void push_to_vector(vector_t*, void*);
 void pull_from_vector(vector_t*, unsigned int);
 void *get_from_vector(vector_t*, unsigned int);
+void reserve_vector(vector_t*, unsigned int);
+void truncate_vector(vector_t*, unsigned int);
+void clear_vector(vector_t*);
 void deconstruct_vector(vector_t*);
@@ -52,6 +52,12 @@ void setup_global_configuration() {
     setting = create_or_get_kv_pair(configuration, "border.colors.flipped");
     setting->value->boolean = 0;
 
+    setting = create_or_get_kv_pair(configuration, "border.strips");
+    setting->value->boolean = 0;
+
+    setting = create_or_get_kv_pair(configuration, "border.cache.size");
+    setting->value->number = 64;
+
     setting = create_or_get_kv_pair(configuration, "workspaces");
     setting->value->number = 1;
 }
@@ -1,18 +1,23 @@
 #include <poll.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <stdarg.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/signalfd.h>
 
 #include "custard.h"
 #include "config.h"
 #include "decorations.h"
+#include "events.h"
 #include "handlers.h"
+#include "latency.h"
 #include "monitor.h"
 #include "rules.h"
+#include "watchdog.h"
 #include "window.h"
 
+#include "../timer.h"
 #include "../vector.h"
 
 #include "../ipc/ipc.h"
@@ -20,12 +25,55 @@
 #include "../ipc/socket.h"
 #include "../xcb/connection.h"
 #include "../xcb/ewmh.h"
+#include "../xcb/statistics.h"
 #include "../xcb/window.h"
 #include "../xcb/xrandr.h"
 
 char *rc_path = NULL;
-unsigned short loglevel = 1;
 unsigned short custard_is_running = 0;
+int signal_file_descriptor = -1;
+
+static sigset_t signal_mask;
+static unsigned int accept_retry_timer = 0;
+
+static void retry_accepting_connections(void *data) {
+    suppress_unused(data);
+
+    /* Descriptors may have been freed by something other than a client */
+    accept_retry_timer = 0;
+    resume_accepting_connections();
+}
+
+static unsigned int build_descriptors(struct pollfd **descriptors,
+    unsigned int *memory) {
+    unsigned int count = FIXED_DESCRIPTORS + ipc_connections->size;
+
+    if (count > *memory) {
+        *memory = count * 2;
+        *descriptors = realloc(*descriptors,
+            *memory * sizeof(struct pollfd));
+    }
+
+    struct pollfd *descriptor = *descriptors;
+    descriptor[0] = (struct pollfd){ xcb_file_descriptor, POLLIN, 0 };
+    descriptor[1] = (struct pollfd){
+        accepting_connections ? socket_file_descriptor : -1, POLLIN, 0
+    };
+    descriptor[2] = (struct pollfd){ signal_file_descriptor, POLLIN, 0 };
+    descriptor[3] = (struct pollfd){ ring_file_descriptor, POLLIN, 0 };
+
+    /* One per client, in the order of ipc_connections */
+    ipc_connection_t *connection;
+    for (unsigned int index = 0; index < ipc_connections->size; index++) {
+        connection = get_from_vector(ipc_connections, index);
+        descriptor[FIXED_DESCRIPTORS + index] = (struct pollfd){
+            connection->file_descriptor,
+            connection->state == CONNECTION_WRITING ? POLLOUT : POLLIN, 0
+        };
+    }
+
+    return count;
+}
 
 int custard(int argc, char **argv) {
     rc_path = (char *)calloc(512, sizeof(char));
@@ -48,9 +96,33 @@ int custard(int argc, char **argv) {
             strcpy(rc_path, argv[index]);
         } else if (!strcmp(argument, "--loglevel")) {
             loglevel = (short)string_to_integer(argv[index]);
+        } else if (!strcmp(argument, "--request-statistics")) {
+            count_requests = string_to_boolean(argv[index]);
+        } else if (!strcmp(argument, "--watchdog")) {
+            watchdog_threshold = string_to_integer(argv[index]);
+        } else if (!strcmp(argument, "--low-latency")) {
+            if (!set_latency_mode(argv[index])) {
+                log_fatal("Unknown latency mode %s, expected nice, fifo "
+                    "or rr", argv[index]);
+                return EXIT_FAILURE;
+            }
+        } else if (!strcmp(argument, "--priority")) {
+            latency_priority = (int)string_to_integer(argv[index]);
         }
 
         index++;
+    }
+
+    /* 0 leaves the choice to the latency mode */
+    if (latency_priority && latency_mode != LATENCY_NORMAL) {
+        int minimum, maximum;
+        latency_priority_range(&minimum, &maximum);
+
+        if (latency_priority < minimum || latency_priority > maximum) {
+            log_fatal("Priority %d out of range, expected %d to %d",
+                latency_priority, minimum, maximum);
+            return EXIT_FAILURE;
+        }
     }
 
     /* initialize window manager */
@@ -77,42 +149,92 @@ int custard(int argc, char **argv) {
                 "Are $HOME or $XDG_CONFIG_HOME set?");
     }
 
-    if (strlen(rc_path) && access(rc_path, X_OK | F_OK | R_OK) > -1) {
-        log_debug("Attempting to execute file at %s", rc_path);
-        if (fork() == 0)
-            execl(rc_path, rc_path, NULL);
-    }
+    run_rc();
 
     custard_is_running = 1;
     manage_pre_existing_windows();
 
-    xcb_generic_event_t *xcb_event;
-    unsigned int xcb_event_type;
+    unsigned int batch_size;
+    unsigned int dropped;
+    unsigned short ready;
+    struct timespec deadline;
 
-    struct pollfd descriptors[2] = {
-        { xcb_file_descriptor,    .events = POLLIN },
-        { socket_file_descriptor, .events = POLLIN }
-    };
+    struct pollfd *descriptors = NULL;
+    unsigned int descriptor_memory = 0;
+    unsigned int descriptor_count;
 
     log_debug("Starting event loop");
     while (custard_is_running) {
+        descriptor_count = build_descriptors(&descriptors, &descriptor_memory);
 
-        if (poll(descriptors, 2, -1)) {
-            if (descriptors[0].revents & POLLIN) {
-                while ((xcb_event = xcb_poll_for_event(xcb_connection))) {
-                    xcb_event_type = xcb_event->response_type & ~0x80;
+        /* Events already queued by xcb must not wait on the socket, and
+         * without pending work or timers poll sleeps indefinitely */
+        ready = poll(descriptors, descriptor_count,
+            (pending_events() || relayout_is_pending()) ?
+            0 : timer_timeout()) > 0;
 
-                    if (xcb_events[xcb_event_type])
-                        xcb_events[xcb_event_type](xcb_event);
+        watchdog_begin_iteration();
 
-                }
+        if (ready && (descriptors[2].revents & POLLIN))
+            dispatch_signals();
+
+        if (ready && (descriptors[0].revents & POLLIN))
+            drain_events();
+
+        /* Everything ready is handled as one batch */
+        batch_size = pending_events();
+        dropped = batch_size ? coalesce_events() : 0;
+
+        /* User input is never kept waiting behind a storm */
+        dispatch_events(INPUT_EVENTS, NULL);
+
+        if (ready) {
+            ipc_service_connections(descriptors + FIXED_DESCRIPTORS,
+                descriptor_count - FIXED_DESCRIPTORS);
+
+            if (descriptors[3].revents & POLLIN)
+                ipc_service_rings();
+
+            if (descriptors[1].revents & POLLIN) {
+                accept_connections();
+
+                if (!accepting_connections && !accept_retry_timer)
+                    accept_retry_timer = add_timer(ACCEPT_RETRY_DELAY, 0,
+                        retry_accepting_connections, NULL);
             }
+        }
 
-            if (descriptors[1].revents & POLLIN)
-                ipc_process_input(read_from_socket());
+        watchdog_note("timers", 0, XCB_WINDOW_NONE);
+        run_timers();
+
+        /* Whatever does not fit in the budget waits for the next pass */
+        set_event_deadline(&deadline);
+
+        if (batch_size) {
+            dispatch_events(STRUCTURAL_EVENTS, &deadline);
+            dispatch_events(COSMETIC_EVENTS, &deadline);
+
+            log_debug("Batch of %d events, %d dropped, %d deferred",
+                batch_size, dropped, pending_events());
+        }
+
+        if (relayout_is_pending()) {
+            watchdog_note("relayout", 0, XCB_WINDOW_NONE);
+            continue_relayout(&deadline);
         }
+
+        /* Every window touched this iteration is flushed exactly once */
+        begin_request_context("flush");
+        watchdog_note("flush", 0, XCB_WINDOW_NONE);
+        apply();
+        end_request_context();
+
+        drain_queued_events();
+        watchdog_end_iteration();
     }
 
+    free(descriptors);
+
     finalize();
 
     return EXIT_SUCCESS;
@@ -128,16 +250,75 @@ unsigned short initialize() {
     setup_global_configuration();
     log_debug("Global configuration setup");
 
-    unsigned int index = 0;
-    for (; index < SIGUNUSED; index++)
+    /* Signals are read from a descriptor in the event loop rather than
+     * interrupting whatever happens to be running */
+    sigemptyset(&signal_mask);
+    for (unsigned int index = 1; index < SIGUNUSED; index++)
         if (signals[index])
-            signal(index, signals[index]);
-    index = 0;
+            sigaddset(&signal_mask, index);
+
+    sigprocmask(SIG_BLOCK, &signal_mask, NULL);
+    signal_file_descriptor = signalfd(-1, &signal_mask,
+        SFD_NONBLOCK | SFD_CLOEXEC);
+
+    if (signal_file_descriptor < 0) {
+        log_fatal("Unable to create signal descriptor");
+        return 0;
+    }
     log_debug("Signal handlers setup");
 
+    enter_low_latency_mode();
+
+    if (!start_watchdog())
+        return 0;
+
+    setup_event_masks();
+    log_debug("Event masks setup");
+
     return 1;
 }
 
+void run_rc() {
+    if (!strlen(rc_path) || access(rc_path, X_OK | F_OK | R_OK) < 0)
+        return;
+
+    log_debug("Attempting to execute file at %s", rc_path);
+    if (fork() == 0) {
+        /* The blocked mask survives exec; children get normal signals */
+        sigprocmask(SIG_UNBLOCK, &signal_mask, NULL);
+        leave_low_latency_mode();
+        execl(rc_path, rc_path, NULL);
+        _exit(EXIT_FAILURE);
+    }
+}
+
+void dispatch_signals() {
+    struct signalfd_siginfo information;
+
+    while (read(signal_file_descriptor, &information, sizeof(information)) ==
+        sizeof(information)) {
+        if (information.ssi_signo < SIGUNUSED &&
+            signals[information.ssi_signo])
+            signals[information.ssi_signo](information.ssi_signo);
+    }
+}
+
+void dump_diagnostics() {
+    log_message("Windows: %d managed, focused(%08x)",
+        windows ? windows->size : 0, focused_window);
+    log_message("Events: %d pending, %d dropped, %d deferred",
+        pending_events(), events_dropped, events_deferred);
+    log_message("Window requests: %d recorded, %d sent, %d dropped",
+        window_requests_recorded, window_requests_sent,
+        window_requests_dropped);
+    log_message("Border pixmaps: %lu bytes, %u hits, %u misses",
+        border_pixmap_memory, border_cache_hits, border_cache_misses);
+
+    char *statistics = format_request_statistics();
+    log_message("Requests:\n%s", statistics);
+    free(statistics);
+}
+
 void manage_pre_existing_windows() {
     unsigned int index = 0;
     xcb_query_tree_cookie_t query_cookie;
@@ -145,7 +326,8 @@ void manage_pre_existing_windows() {
         xcb_screen->root);
 
     xcb_query_tree_reply_t *tree_reply;
-    tree_reply = xcb_query_tree_reply(xcb_connection, query_cookie, NULL);
+    round_trip(tree_reply = xcb_query_tree_reply(xcb_connection, query_cookie,
+        NULL));
 
     if (!tree_reply)
         return;
@@ -162,10 +344,6 @@ void manage_pre_existing_windows() {
         if (window_should_be_managed(child)) {
             window = manage_window(child);
             map_window(child);
-            xcb_grab_button(xcb_connection, 0, child,
-                XCB_EVENT_MASK_BUTTON_PRESS,
-                XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC,
-                XCB_NONE, XCB_NONE,  XCB_BUTTON_INDEX_ANY, XCB_MOD_MASK_ANY);
             decorate(window);
             log_debug("Pre-existing window(%08x) managed",
                 child, window->workspace);
@@ -176,8 +354,6 @@ void manage_pre_existing_windows() {
     if (window) {
     // Raise and focus the last window
         focused_window = window->id;
-        xcb_ungrab_button(xcb_connection,
-            XCB_BUTTON_INDEX_ANY, focused_window, XCB_MOD_MASK_ANY);
         raise_window(window->parent);
         focus_window(window->id);
         decorate(window);
@@ -226,6 +402,8 @@ void finalize() {
         }
     }
 
+    free_monitor_index();
+
     if (configuration) {
         log_debug("Freeing memory for configuration");
         while ((kv_pair = vector_iterator(configuration))) {
@@ -256,33 +434,19 @@ void finalize() {
         deconstruct_vector(rules);
     }
 
+    stop_watchdog();
+    finalize_decorations();
+    finalize_window_states();
+    cancel_relayout();
+    finalize_events();
+    finalize_timers();
+    finalize_request_statistics();
     finalize_xcb();
     finalize_ewmh();
     finalize_socket();
 
-    free(rc_path);
-}
-
-void _log(unsigned short level, const char *file, const char *function,
-    const int line, char *formatting, ...) {
-
-    /*
-     * Loglevels:
-     * 0 - Absolutely fucking nothing
-     * 1 - Fatal
-     * 2 - Message
-     * 3 - Debug
-     */
-
-     if (loglevel < level)
-        return;
-
-    fprintf(stderr, "%s:%s L%d: ", file, function, line);
+    if (signal_file_descriptor >= 0)
+        close(signal_file_descriptor);
 
-    va_list ap;
-    va_start(ap, formatting);
-    vfprintf(stderr, formatting, ap);
-    va_end(ap);
-
-    fputs("\n", stderr);
+    free(rc_path);
 }
@@ -1,18 +1,22 @@
 #pragma once
 
+#include "../log.h"
 #include "../vector.h"
 
 extern char *rc_path;
-extern unsigned short loglevel;
 extern unsigned short custard_is_running;
+extern int signal_file_descriptor;
+
+/* X, the IPC listener, signals and rings; clients follow in the poll set */
+#define FIXED_DESCRIPTORS 4
+
+/* Microseconds before accepting again after running out of descriptors */
+#define ACCEPT_RETRY_DELAY 1000000
 
 int custard(int, char**);
 unsigned short initialize(void);
+void run_rc(void);
+void dispatch_signals(void);
+void dump_diagnostics(void);
 void manage_pre_existing_windows(void);
 void finalize(void);
-
-void _log(unsigned short, const char*, const char*, const int, char*, ...);
-#define log_fatal(...) _log(1, __FILE__, __func__, __LINE__, __VA_ARGS__)
-#define log_message(...) _log(2, __FILE__, __func__, __LINE__, __VA_ARGS__)
-#define log_debug(...) _log(3, __FILE__, __func__, __LINE__, __VA_ARGS__)
-#define suppress_unused(...) (void)(__VA_ARGS__)
@@ -1,11 +1,26 @@
+#include <stdlib.h>
+#include <string.h>
 #include <xcb/xcb.h>
 
+#include "custard.h"
 #include "grid.h"
 #include "decorations.h"
 #include "window.h"
+#include "../timer.h"
 #include "../xcb/connection.h"
+#include "../xcb/errors.h"
 #include "../xcb/window.h"
 
+vector_t *border_pixmaps = NULL;
+table_t *border_pixmap_table = NULL;
+unsigned long border_pixmap_memory = 0;
+unsigned int border_cache_hits = 0;
+unsigned int border_cache_misses = 0;
+
+static xcb_gcontext_t graphics_contexts[33];
+static unsigned long border_pixmap_clock = 0;
+static unsigned int border_trim_timer = 0;
+
 void apply_decoration_to_window_screen_geometry(window_t *window,
     screen_geometry_t *geometry) {
 
@@ -63,11 +78,10 @@ void decorate(window_t *window) {
     if (border_type > 3)
         border_type = 3;
 
-    unsigned int values[1] = { 0 };
-
     if (!border_type) {
-        configure_window(window->parent,
-            XCB_CONFIG_WINDOW_BORDER_WIDTH, values);
+        release_window_decorations(window);
+        destroy_border_strips(window);
+        set_border_size(window, 0);
         return;
     }
 
@@ -77,25 +91,27 @@ void decorate(window_t *window) {
     if (focused_window == window->id)
         window_is_focused = 1;
 
-    /* Color */
+    /* Color, for both focus states; index 1 is focused */
 
     unsigned short inverted_borders = get_setting_from_window_rules(window,
         "border.colors.flipped")->boolean;
 
-    char *color_setting = "border.color.unfocused";
-    if (window_is_focused)
-        color_setting = "border.color.focused";
-
     color_t background_color = get_setting_from_window_rules(window,
         "border.color.background")->color;
 
-    color_t primary_color = get_setting_from_window_rules(window,
-        color_setting)->color;
-    color_t secondary_color = background_color;
+    color_t primary_colors[2] = {
+        get_setting_from_window_rules(window,
+            "border.color.unfocused")->color,
+        get_setting_from_window_rules(window,
+            "border.color.focused")->color
+    };
+    color_t secondary_colors[2] = { background_color, background_color };
 
     if (inverted_borders) {
-        secondary_color = primary_color;
-        primary_color = background_color;
+        for (unsigned int state = 0; state < 2; state++) {
+            secondary_colors[state] = primary_colors[state];
+            primary_colors[state] = background_color;
+        }
     }
 
     /* Size */
@@ -114,94 +130,460 @@ void decorate(window_t *window) {
     /* Which border method? */
 
     if (border_type == 1) {
-        single_border(window->parent, outer_size, primary_color);
+        release_window_decorations(window);
+        destroy_border_strips(window);
+        single_border(window, outer_size, primary_colors[window_is_focused]);
         return;
     }
 
     /* Multiborder */
 
-    multi_border(window->parent, inner_size, outer_size,
-        primary_color, secondary_color, border_type);
+    if (get_setting_from_window_rules(window, "border.strips")->boolean) {
+        release_window_decorations(window);
+        strip_border(window, inner_size, outer_size,
+            primary_colors, secondary_colors, border_type, window_is_focused);
+        return;
+    }
+
+    destroy_border_strips(window);
+    multi_border(window, inner_size, outer_size,
+        primary_colors, secondary_colors, border_type, window_is_focused);
 
 }
 
-void single_border(xcb_window_t window, unsigned int border_size,
-    color_t color) {
-    /* Single border, configure window */
+void set_border_size(window_t *window, unsigned int border_size) {
+    if (window->border_size == border_size)
+        return;
+
     unsigned int values[1] = { border_size };
-    configure_window(window, XCB_CONFIG_WINDOW_BORDER_WIDTH, values);
+    configure_window(window->parent, XCB_CONFIG_WINDOW_BORDER_WIDTH, values);
+
+    window->border_size = border_size;
+}
+
+void single_border(window_t *window, unsigned int border_size,
+    color_t color) {
+    /* Single border; a focus change only swaps the border pixel */
+    set_border_size(window, border_size);
 
-    values[0] = get_raw_color_value(color);
-    xcb_change_window_attributes(xcb_connection, window,
+    unsigned int values[1] = { get_raw_color_value(color) };
+    change_window_attributes(window->parent,
         XCB_CW_BORDER_PIXEL, values);
 }
 
-void multi_border(xcb_window_t window,
+void multi_border(window_t *window,
     unsigned int inner_size, unsigned int outer_size,
-    color_t primary_color, color_t secondary_color,
-    unsigned short border_type) {
+    color_t *primary_colors, color_t *secondary_colors,
+    unsigned short border_type, unsigned short window_is_focused) {
+
+    unsigned int border_size = (outer_size * (border_type - 1)) + inner_size;
+    set_border_size(window, border_size);
+
+    /*
+     * Both focus states are built together whenever the geometry or the
+     * style changes, so a focus change is a single attribute change.
+     */
+
+    border_key_t key;
+    for (unsigned int state = 0; state < 2; state++) {
+        key = (border_key_t) {
+            .height          = (border_size * 2) +
+                window->frame_geometry.height,
+            .width           = (border_size * 2) +
+                window->frame_geometry.width,
+            .border_type     = border_type,
+            .inner_size      = inner_size,
+            .outer_size      = outer_size,
+            .primary_color   = get_raw_color_value(primary_colors[state]),
+            .secondary_color = get_raw_color_value(secondary_colors[state])
+        };
+
+        if (window->borders[state] &&
+            !memcmp(&window->borders[state]->key, &key, sizeof(border_key_t)))
+            continue;
+
+        release_border_pixmap(window->borders[state]);
+        window->borders[state] = acquire_border_pixmap(&key);
+    }
+
+    border_pixmap_t *border_pixmap = window->borders[window_is_focused];
+
+    /* Value order follows the mask: back pixel, then border pixmap */
+    unsigned int values[2] = {
+        (border_type == 2) ? border_pixmap->key.primary_color :
+            border_pixmap->key.secondary_color,
+        border_pixmap->pixmap
+    };
+
+    change_window_attributes(window->parent,
+        XCB_CW_BACK_PIXEL | XCB_CW_BORDER_PIXMAP, values);
+}
+
+void strip_border(window_t *window,
+    unsigned int inner_size, unsigned int outer_size,
+    color_t *primary_colors, color_t *secondary_colors,
+    unsigned short border_type, unsigned short window_is_focused) {
+
+    /*
+     * Multi borders without a pixmap. The outermost band is the frame's
+     * own border pixel, the next band is the frame's background showing
+     * around the client (see get_client_offset), and for triple borders
+     * the band touching the client is four thin strip windows. Memory
+     * use no longer depends on the size of the window.
+     */
+
+    set_border_size(window, outer_size);
+
+    unsigned int primary_color = get_raw_color_value(
+        primary_colors[window_is_focused]);
+    unsigned int secondary_color = get_raw_color_value(
+        secondary_colors[window_is_focused]);
+
+    /* Value order follows the mask: back pixel, then border pixel */
+    unsigned int values[3] = { primary_color, secondary_color, 0 };
+    change_window_attributes(window->parent,
+        XCB_CW_BACK_PIXEL | XCB_CW_BORDER_PIXEL, values);
+    clear_window(window->parent);
+
+    if (border_type == 2) {
+        destroy_border_strips(window);
+        return;
+    }
+
+    pixel_geometry_t *geometry = &window->frame_geometry;
+    unsigned int index;
+
+    if (!window->strips[0]) {
+        values[0] = secondary_color;
+        values[1] = 0;
+        values[2] = screen_colormap;
+
+        for (index = 0; index < 4; index++) {
+            window->strips[index] = xcb_generate_id(xcb_connection);
+            track_request(xcb_create_window(xcb_connection, 32,
+                window->strips[index], window->parent,
+                0, 0, 1, 1, 0,
+                XCB_WINDOW_CLASS_INPUT_OUTPUT, screen_visual->visual_id,
+                XCB_CW_BACK_PIXEL | XCB_CW_BORDER_PIXEL | XCB_CW_COLORMAP,
+                values).sequence, "CreateWindow", window->strips[index]);
+            map_window(window->strips[index]);
+        }
+
+        memset(&window->strip_geometry, 0, sizeof(pixel_geometry_t));
+    } else {
+        values[0] = secondary_color;
+        for (index = 0; index < 4; index++) {
+            change_window_attributes(window->strips[index],
+                XCB_CW_BACK_PIXEL, values);
+            clear_window(window->strips[index]);
+        }
+    }
 
-    unsigned int values[1];
+    if (!memcmp(&window->strip_geometry, geometry, sizeof(pixel_geometry_t)))
+        return;
+
+    window->strip_geometry = *geometry;
+
+    /* Frame interior is the client plus (inner + outer) on each side */
+
+    unsigned int client_height = geometry->height -
+        ((inner_size + outer_size) * 2);
+    unsigned int client_width = geometry->width -
+        ((inner_size + outer_size) * 2);
+
+    unsigned int strips[4][4] = {
+        /* x, y, width, height */
+        { inner_size, inner_size,
+            client_width + (outer_size * 2), outer_size },
+        { inner_size, inner_size + outer_size + client_height,
+            client_width + (outer_size * 2), outer_size },
+        { inner_size, inner_size + outer_size,
+            outer_size, client_height },
+        { inner_size + outer_size + client_width, inner_size + outer_size,
+            outer_size, client_height }
+    };
+
+    for (index = 0; index < 4; index++)
+        configure_window(window->strips[index],
+            XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y |
+            XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT,
+            strips[index]);
+}
 
-    xcb_get_geometry_cookie_t geometry_cookie = xcb_get_geometry(xcb_connection,
-        window);
-    xcb_get_geometry_reply_t *geometry;
+void destroy_border_strips(window_t *window) {
+    if (!window->strips[0])
+        return;
+
+    for (unsigned int index = 0; index < 4; index++) {
+        track_request(xcb_destroy_window(xcb_connection,
+            window->strips[index]).sequence, "DestroyWindow",
+            window->strips[index]);
+        forget_window(window->strips[index]);
+        window->strips[index] = XCB_WINDOW_NONE;
+    }
+}
+
+unsigned int get_client_offset(window_t *window) {
+    /* Distance between the frame's inner edge and the client */
+
+    unsigned int border_type = get_setting_from_window_rules(window,
+        "borders")->number;
+
+    if (border_type < 2 || !get_setting_from_window_rules(window,
+        "border.strips")->boolean)
+        return 0;
+
+    if (border_type > 3)
+        border_type = 3;
+
+    unsigned int outer_size = get_setting_from_window_rules(window,
+        "border.size.outer")->number;
+    unsigned int inner_size = get_setting_from_window_rules(window,
+        "border.size.inner")->number;
+
+    if (!outer_size)
+        outer_size = 1;
+
+    if (!inner_size)
+        inner_size = 1;
+
+    return (outer_size * (border_type - 2)) + inner_size;
+}
+
+void release_window_decorations(window_t *window) {
+    for (unsigned int state = 0; state < 2; state++) {
+        release_border_pixmap(window->borders[state]);
+        window->borders[state] = NULL;
+    }
+}
+
+xcb_gcontext_t graphics_context_for_depth(unsigned char depth) {
+    if (graphics_contexts[depth])
+        return graphics_contexts[depth];
+
+    /* A GC is usable on any drawable of the depth it was created for */
 
     xcb_pixmap_t pixmap = xcb_generate_id(xcb_connection);
-    xcb_gcontext_t graphics_context = xcb_generate_id(xcb_connection);
+    xcb_create_pixmap(xcb_connection, depth, pixmap, xcb_screen->root, 1, 1);
 
-    unsigned int border_size = (outer_size * (border_type - 1)) + inner_size;
+    graphics_contexts[depth] = xcb_generate_id(xcb_connection);
+    xcb_create_gc(xcb_connection, graphics_contexts[depth], pixmap, 0, NULL);
 
-    values[0] = border_size;
-    configure_window(window, XCB_CONFIG_WINDOW_BORDER_WIDTH, values);
+    xcb_free_pixmap(xcb_connection, pixmap);
 
-    geometry = xcb_get_geometry_reply(xcb_connection, geometry_cookie, NULL);
+    return graphics_contexts[depth];
+}
+
+static unsigned int hash_border_key(border_key_t *key) {
+    /* FNV-1a over the key; the table reserves 0 for empty slots */
+    unsigned char *bytes = (unsigned char*)key;
+    unsigned int hash = 2166136261u;
+
+    for (unsigned int index = 0; index < sizeof(border_key_t); index++)
+        hash = (hash ^ bytes[index]) * 16777619u;
+
+    return hash ? hash : 1;
+}
 
-    unsigned short height = (unsigned short)((border_size * 2) +
-        geometry->height);
-    unsigned short width = (unsigned short)((border_size * 2) +
-        geometry->width);
+static void unlink_border_pixmap(border_pixmap_t *border_pixmap) {
+    unsigned int hash = hash_border_key(&border_pixmap->key);
+    border_pixmap_t *head = get_from_table(border_pixmap_table, hash);
 
-    xcb_create_pixmap(xcb_connection, 32, pixmap, xcb_screen->root,
-        width, height);
-    xcb_create_gc(xcb_connection, graphics_context, pixmap, 0, NULL);
+    if (head == border_pixmap) {
+        if (border_pixmap->next)
+            insert_into_table(border_pixmap_table, hash, border_pixmap->next);
+        else
+            pull_from_table(border_pixmap_table, hash);
+        return;
+    }
+
+    for (; head; head = head->next) {
+        if (head->next == border_pixmap) {
+            head->next = border_pixmap->next;
+            return;
+        }
+    }
+}
+
+border_pixmap_t *acquire_border_pixmap(border_key_t *key) {
+    if (!border_pixmaps) {
+        border_pixmaps = construct_vector();
+        border_pixmap_table = construct_table();
+    }
 
-    values[0] = get_raw_color_value(secondary_color);
+    unsigned int hash = hash_border_key(key);
+
+    border_pixmap_t *border_pixmap;
+    for (border_pixmap = get_from_table(border_pixmap_table, hash);
+        border_pixmap; border_pixmap = border_pixmap->next) {
+        if (!memcmp(&border_pixmap->key, key, sizeof(border_key_t))) {
+            border_pixmap->last_used = ++border_pixmap_clock;
+            border_pixmap->references++;
+            border_cache_hits++;
+            return border_pixmap;
+        }
+    }
+
+    border_cache_misses++;
+
+    border_pixmap = (border_pixmap_t*)calloc(1, sizeof(border_pixmap_t));
+    border_pixmap->key = *key;
+    border_pixmap->pixmap = xcb_generate_id(xcb_connection);
+    border_pixmap->memory = (unsigned long)key->height * key->width * 4;
+    border_pixmap->last_used = ++border_pixmap_clock;
+    border_pixmap->references = 1;
+
+    xcb_gcontext_t graphics_context = graphics_context_for_depth(32);
+
+    xcb_create_pixmap(xcb_connection, 32, border_pixmap->pixmap,
+        xcb_screen->root, (unsigned short)key->width,
+        (unsigned short)key->height);
+
+    unsigned int values[1] = { key->secondary_color };
     xcb_change_gc(xcb_connection, graphics_context,
         XCB_GC_FOREGROUND, values);
 
-    xcb_rectangle_t outer_border[4] = { { 0, 0, width, height } };
-    xcb_poly_fill_rectangle(xcb_connection, pixmap, graphics_context,
-        4, outer_border);
+    xcb_rectangle_t outer_border[1] = {
+        { 0, 0, (unsigned short)key->width, (unsigned short)key->height }
+    };
+    xcb_poly_fill_rectangle(xcb_connection, border_pixmap->pixmap,
+        graphics_context, 1, outer_border);
 
-    values[0] = get_raw_color_value(primary_color);
+    values[0] = key->primary_color;
     xcb_change_gc(xcb_connection, graphics_context,
         XCB_GC_FOREGROUND, values);
 
-    if (border_type == 2)
-        double_border_transient(pixmap, graphics_context,
-            inner_size, outer_size, border_size, geometry);
-    else {
-        triple_border_transient(pixmap, graphics_context,
-            inner_size, outer_size, border_size, geometry);
-        values[0] = get_raw_color_value(secondary_color);
+    unsigned int border_size = (key->outer_size * (key->border_type - 1)) +
+        key->inner_size;
+    pixel_geometry_t geometry = {
+        .x      = 0,
+        .y      = 0,
+        .height = key->height - (border_size * 2),
+        .width  = key->width - (border_size * 2)
+    };
+
+    if (key->border_type == 2)
+        double_border_transient(border_pixmap->pixmap, graphics_context,
+            key->inner_size, key->outer_size, border_size, &geometry);
+    else
+        triple_border_transient(border_pixmap->pixmap, graphics_context,
+            key->inner_size, key->outer_size, border_size, &geometry);
+
+    push_to_vector(border_pixmaps, border_pixmap);
+    border_pixmap->next = get_from_table(border_pixmap_table, hash);
+    insert_into_table(border_pixmap_table, hash, border_pixmap);
+    border_pixmap_memory += border_pixmap->memory;
+
+    schedule_border_trim();
+
+    log_debug("Border pixmap cache: %u hits, %u misses, %lu bytes",
+        border_cache_hits, border_cache_misses, border_pixmap_memory);
+
+    return border_pixmap;
+}
+
+void release_border_pixmap(border_pixmap_t *border_pixmap) {
+    if (!border_pixmap)
+        return;
+
+    if (border_pixmap->references)
+        border_pixmap->references--;
+
+    schedule_border_trim();
+}
+
+static unsigned long border_cache_budget() {
+    /* Megabytes in the configuration, too many for an unsigned int */
+    return (unsigned long)get_value_from_key(configuration,
+        "border.cache.size")->number * 1024 * 1024;
+}
+
+static void trim_border_pixmaps(void *data) {
+    suppress_unused(data);
+
+    border_trim_timer = 0;
+    evict_border_pixmaps(border_cache_budget());
+}
+
+void schedule_border_trim() {
+    /*
+     * A pixmap released by one window is often taken again right away,
+     * e.g. by a focus change, so the cache is trimmed a little later.
+     */
+    if (border_trim_timer || border_pixmap_memory <= border_cache_budget())
+        return;
+
+    border_trim_timer = add_timer(BORDER_TRIM_DELAY, 0, trim_border_pixmaps,
+        NULL);
+}
+
+void evict_border_pixmaps(unsigned long budget) {
+    /*
+     * Least recently used pixmaps go first. Pixmaps still held by a
+     * window are never evicted.
+     */
+
+    border_pixmap_t *border_pixmap, *oldest;
+    unsigned int index, oldest_index;
+
+    while (border_pixmap_memory > budget) {
+        oldest = NULL;
+        oldest_index = 0;
+
+        for (index = 0; index < border_pixmaps->size; index++) {
+            border_pixmap = get_from_vector(border_pixmaps, index);
+
+            if (border_pixmap->references)
+                continue;
+
+            if (!oldest || border_pixmap->last_used < oldest->last_used) {
+                oldest = border_pixmap;
+                oldest_index = index;
+            }
+        }
+
+        if (!oldest)
+            return;
+
+        xcb_free_pixmap(xcb_connection, oldest->pixmap);
+        border_pixmap_memory -= oldest->memory;
+
+        unlink_border_pixmap(oldest);
+        pull_from_vector(border_pixmaps, oldest_index);
+        free(oldest);
     }
+}
 
-    xcb_change_window_attributes(xcb_connection, window,
-        XCB_CW_BACK_PIXEL, values);
+void finalize_decorations() {
+    cancel_timer(border_trim_timer);
+    border_trim_timer = 0;
 
-    values[0] = pixmap;
-    xcb_change_window_attributes(xcb_connection, window,
-        XCB_CW_BORDER_PIXMAP, values);
+    if (border_pixmaps) {
+        log_debug("Freeing memory for border pixmaps");
+        border_pixmap_t *border_pixmap;
+        while ((border_pixmap = vector_iterator(border_pixmaps))) {
+            xcb_free_pixmap(xcb_connection, border_pixmap->pixmap);
+            free(border_pixmap);
+        }
+        deconstruct_vector(border_pixmaps);
+        deconstruct_table(border_pixmap_table);
+        border_pixmaps = NULL;
+        border_pixmap_table = NULL;
+        border_pixmap_memory = 0;
+    }
 
-    xcb_free_pixmap(xcb_connection, pixmap);
-    xcb_free_gc(xcb_connection, graphics_context);
+    for (unsigned int depth = 0; depth < 33; depth++) {
+        if (graphics_contexts[depth]) {
+            xcb_free_gc(xcb_connection, graphics_contexts[depth]);
+            graphics_contexts[depth] = 0;
+        }
+    }
 }
 
 void double_border_transient(xcb_pixmap_t pixmap,
     xcb_gcontext_t graphics_context, unsigned int inner_size,
     unsigned int outer_size, unsigned int border_size,
-    xcb_get_geometry_reply_t *geometry) {
+    pixel_geometry_t *geometry) {
 
     xcb_rectangle_t inner_border[5] = {
         {
@@ -238,7 +620,7 @@ void double_border_transient(xcb_pixmap_t pixmap,
 void triple_border_transient(xcb_pixmap_t pixmap,
     xcb_gcontext_t graphics_context, unsigned int inner_size,
     unsigned int outer_size, unsigned int border_size,
-    xcb_get_geometry_reply_t *geometry) {
+    pixel_geometry_t *geometry) {
 
     xcb_rectangle_t inner_border[8] = {
         {
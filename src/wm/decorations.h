@@ -4,15 +4,59 @@
 #include "geometry.h"
 #include "window.h"
 
+#include "../table.h"
+#include "../vector.h"
+
+/* Microseconds an unused border pixmap is kept over the cache budget */
+#define BORDER_TRIM_DELAY 1000000
+
+typedef struct {
+    unsigned int height;
+    unsigned int width;
+    unsigned int border_type;
+    unsigned int inner_size;
+    unsigned int outer_size;
+    unsigned int primary_color;
+    unsigned int secondary_color;
+} border_key_t;
+
+struct border_pixmap {
+    border_key_t key;
+    xcb_pixmap_t pixmap;
+    unsigned long memory;
+    unsigned int references;
+    unsigned long last_used;
+    struct border_pixmap *next; /* same hash in border_pixmap_table */
+};
+
+extern vector_t *border_pixmaps;
+extern table_t *border_pixmap_table;
+extern unsigned long border_pixmap_memory;
+extern unsigned int border_cache_hits;
+extern unsigned int border_cache_misses;
+
 void apply_decoration_to_window_screen_geometry(window_t*, screen_geometry_t*);
 unsigned int get_raw_color_value(color_t);
 void decorate(window_t*);
 
-void single_border(xcb_window_t, unsigned int, color_t);
-void multi_border(xcb_window_t, unsigned int, unsigned int, color_t, color_t,
-    unsigned short);
+void set_border_size(window_t*, unsigned int);
+void single_border(window_t*, unsigned int, color_t);
+void multi_border(window_t*, unsigned int, unsigned int, color_t*, color_t*,
+    unsigned short, unsigned short);
+void strip_border(window_t*, unsigned int, unsigned int, color_t*, color_t*,
+    unsigned short, unsigned short);
+void destroy_border_strips(window_t*);
+unsigned int get_client_offset(window_t*);
+void release_window_decorations(window_t*);
+
+xcb_gcontext_t graphics_context_for_depth(unsigned char);
+border_pixmap_t *acquire_border_pixmap(border_key_t*);
+void release_border_pixmap(border_pixmap_t*);
+void schedule_border_trim(void);
+void evict_border_pixmaps(unsigned long);
+void finalize_decorations(void);
 
 void double_border_transient(xcb_pixmap_t, xcb_gcontext_t,
-    unsigned int, unsigned int, unsigned int, xcb_get_geometry_reply_t*);
+    unsigned int, unsigned int, unsigned int, pixel_geometry_t*);
 void triple_border_transient(xcb_pixmap_t, xcb_gcontext_t,
-    unsigned int, unsigned int, unsigned int, xcb_get_geometry_reply_t*);
+    unsigned int, unsigned int, unsigned int, pixel_geometry_t*);
@@ -0,0 +1,274 @@
+#include <stdlib.h>
+#include <string.h>
+#include <xcb/xcb.h>
+#include <xcb/xcb_event.h>
+
+#include "custard.h"
+#include "events.h"
+#include "handlers.h"
+#include "watchdog.h"
+
+#include "../table.h"
+#include "../xcb/connection.h"
+#include "../xcb/statistics.h"
+
+vector_t *event_queues[EVENT_CLASSES];
+unsigned int events_dropped = 0;
+unsigned int events_deferred = 0;
+
+static table_t *latest_events = NULL;
+
+/* Looked up by name once per event type, not once per event */
+static request_statistics_t *event_contexts[XCB_NO_OPERATION + 1];
+
+/* Anything not listed is structural */
+static const event_class_t event_classes[XCB_NO_OPERATION + 1] = {
+    [XCB_KEY_PRESS]       = INPUT_EVENTS,
+    [XCB_KEY_RELEASE]     = INPUT_EVENTS,
+    [XCB_BUTTON_PRESS]    = INPUT_EVENTS,
+    [XCB_BUTTON_RELEASE]  = INPUT_EVENTS,
+    [XCB_MOTION_NOTIFY]   = INPUT_EVENTS,
+    [XCB_ENTER_NOTIFY]    = INPUT_EVENTS,
+    [XCB_LEAVE_NOTIFY]    = INPUT_EVENTS,
+    [XCB_EXPOSE]          = COSMETIC_EVENTS,
+    [XCB_PROPERTY_NOTIFY] = COSMETIC_EVENTS,
+};
+
+static void queue_event(xcb_generic_event_t *event) {
+    unsigned char type = event->response_type & ~0x80;
+
+    if (!xcb_events[type]) {
+        free(event);
+        return;
+    }
+
+    event_class_t event_class = event_classes[type];
+    if (!event_queues[event_class])
+        event_queues[event_class] = construct_vector();
+
+    push_to_vector(event_queues[event_class], event);
+}
+
+void reserve_events(unsigned int count) {
+    for (unsigned int index = 0; index < EVENT_CLASSES; index++) {
+        if (!event_queues[index])
+            event_queues[index] = construct_vector();
+
+        reserve_vector(event_queues[index], count);
+    }
+
+    if (!latest_events)
+        latest_events = construct_table();
+
+    reserve_table(latest_events, count);
+}
+
+unsigned int drain_events() {
+    xcb_generic_event_t *event;
+    while ((event = xcb_poll_for_event(xcb_connection)))
+        queue_event(event);
+
+    return pending_events();
+}
+
+unsigned int drain_queued_events() {
+    /* Waiting on a reply reads any events ahead of it into xcb's queue,
+     * where they would not wake poll */
+    xcb_generic_event_t *event;
+    while ((event = xcb_poll_for_queued_event(xcb_connection)))
+        queue_event(event);
+
+    return pending_events();
+}
+
+unsigned int pending_events() {
+    unsigned int pending = 0;
+
+    for (unsigned int index = 0; index < EVENT_CLASSES; index++)
+        if (event_queues[index])
+            pending += event_queues[index]->size;
+
+    return pending;
+}
+
+static xcb_window_t event_window(xcb_generic_event_t *event) {
+    switch (event->response_type & ~0x80) {
+        case 0:
+            return ((xcb_generic_error_t*)event)->resource_id;
+        case XCB_BUTTON_PRESS:
+        case XCB_BUTTON_RELEASE:
+            return ((xcb_button_press_event_t*)event)->event;
+        case XCB_MAP_REQUEST:
+            return ((xcb_map_request_event_t*)event)->window;
+        case XCB_DESTROY_NOTIFY:
+            return ((xcb_destroy_notify_event_t*)event)->window;
+        case XCB_CONFIGURE_NOTIFY:
+            return ((xcb_configure_notify_event_t*)event)->window;
+        case XCB_MAP_NOTIFY:
+            return ((xcb_map_notify_event_t*)event)->window;
+        case XCB_UNMAP_NOTIFY:
+            return ((xcb_unmap_notify_event_t*)event)->window;
+        case XCB_PROPERTY_NOTIFY:
+            return ((xcb_property_notify_event_t*)event)->window;
+        case XCB_CLIENT_MESSAGE:
+            return ((xcb_client_message_event_t*)event)->window;
+        default:
+            return XCB_WINDOW_NONE;
+    }
+}
+
+static unsigned int coalescing_key(xcb_generic_event_t *event) {
+    /* Resource ids fit in 29 bits, leaving the top bits for the type */
+    switch (event->response_type & ~0x80) {
+        case XCB_CONFIGURE_NOTIFY:
+            return (1u << 29) |
+                ((xcb_configure_notify_event_t*)event)->window;
+        case XCB_PROPERTY_NOTIFY:
+            return (2u << 29) |
+                ((xcb_property_notify_event_t*)event)->window;
+        case XCB_MOTION_NOTIFY:
+            return (3u << 29) |
+                ((xcb_motion_notify_event_t*)event)->event;
+        default:
+            return 0;
+    }
+}
+
+static unsigned short is_obsolete(xcb_generic_event_t *event,
+    xcb_generic_event_t *later_event) {
+    if ((event->response_type & ~0x80) != XCB_PROPERTY_NOTIFY)
+        return 1;
+
+    return ((xcb_property_notify_event_t*)event)->atom ==
+        ((xcb_property_notify_event_t*)later_event)->atom;
+}
+
+static unsigned int coalesce_queue(vector_t *queue) {
+    unsigned int dropped = 0;
+    unsigned int key, kept = 0, index;
+    xcb_generic_event_t *event, *later_event;
+
+    /* Walk backwards so the newest event of each kind is the one kept */
+    for (index = queue->size; index--;) {
+        event = get_from_vector(queue, index);
+
+        if (!(key = coalescing_key(event)))
+            continue;
+
+        later_event = get_from_table(latest_events, key);
+        if (later_event && is_obsolete(event, later_event)) {
+            free(event);
+            queue->elements[index] = NULL;
+            dropped++;
+            continue;
+        }
+
+        insert_into_table(latest_events, key, event);
+    }
+
+    clear_table(latest_events);
+
+    for (index = 0; index < queue->size; index++)
+        if (queue->elements[index])
+            queue->elements[kept++] = queue->elements[index];
+
+    truncate_vector(queue, kept);
+
+    return dropped;
+}
+
+unsigned int coalesce_events() {
+    if (!latest_events)
+        latest_events = construct_table();
+
+    unsigned int dropped = 0;
+    for (unsigned int index = 0; index < EVENT_CLASSES; index++)
+        if (event_queues[index] && event_queues[index]->size > 1)
+            dropped += coalesce_queue(event_queues[index]);
+
+    events_dropped += dropped;
+
+    return dropped;
+}
+
+void set_event_deadline(struct timespec *deadline) {
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+
+    deadline->tv_nsec += EVENT_BUDGET * 1000L;
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+unsigned short deadline_has_passed(struct timespec *deadline) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec > deadline->tv_sec || (now.tv_sec == deadline->tv_sec &&
+        now.tv_nsec >= deadline->tv_nsec);
+}
+
+unsigned int dispatch_events(event_class_t event_class,
+    struct timespec *deadline) {
+    vector_t *queue = event_queues[event_class];
+    if (!queue || !queue->size)
+        return 0;
+
+    xcb_generic_event_t *event;
+    unsigned char type;
+    unsigned int index;
+
+    /* At least one event goes out, so deferred work always progresses */
+    for (index = 0; index < queue->size; index++) {
+        if (index && deadline && deadline_has_passed(deadline))
+            break;
+
+        event = get_from_vector(queue, index);
+        type = event->response_type & ~0x80;
+
+        /* An earlier handler may have removed this one */
+        if (xcb_events[type]) {
+            if (!event_contexts[type])
+                event_contexts[type] = find_request_context(
+                    xcb_event_get_label(type));
+            enter_request_context(event_contexts[type]);
+            watchdog_note(request_context_name(), type, event_window(event));
+            xcb_events[type](event);
+            end_request_context();
+        }
+
+        free(event);
+    }
+
+    unsigned int dispatched = index;
+    unsigned int deferred = queue->size - dispatched;
+
+    for (index = 0; index < deferred; index++)
+        queue->elements[index] = queue->elements[dispatched + index];
+
+    truncate_vector(queue, deferred);
+    events_deferred += deferred;
+
+    return dispatched;
+}
+
+void finalize_events() {
+    for (unsigned int index = 0; index < EVENT_CLASSES; index++) {
+        if (!event_queues[index])
+            continue;
+
+        for (unsigned int event = 0; event < event_queues[index]->size; event++)
+            free(get_from_vector(event_queues[index], event));
+
+        deconstruct_vector(event_queues[index]);
+        event_queues[index] = NULL;
+    }
+
+    if (latest_events) {
+        deconstruct_table(latest_events);
+        latest_events = NULL;
+    }
+
+    memset(event_contexts, 0, sizeof(event_contexts));
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <time.h>
+#include <xcb/xcb.h>
+
+#include "../vector.h"
+
+/* Microseconds per iteration for structural and cosmetic events */
+#define EVENT_BUDGET 4000
+
+typedef enum {
+    STRUCTURAL_EVENTS = 0,
+    INPUT_EVENTS,
+    COSMETIC_EVENTS,
+    EVENT_CLASSES
+} event_class_t;
+
+extern vector_t *event_queues[EVENT_CLASSES];
+extern unsigned int events_dropped;
+extern unsigned int events_deferred;
+
+void reserve_events(unsigned int);
+unsigned int drain_events(void);
+unsigned int drain_queued_events(void);
+unsigned int pending_events(void);
+unsigned int coalesce_events(void);
+void set_event_deadline(struct timespec*);
+unsigned short deadline_has_passed(struct timespec*);
+unsigned int dispatch_events(event_class_t, struct timespec*);
+void finalize_events(void);
@@ -8,7 +8,7 @@ labeled_grid_geometry_t *create_labeled_geometry(char *label, unsigned int x,
     unsigned int y, unsigned int height, unsigned int width) {
     labeled_grid_geometry_t *geometry = (labeled_grid_geometry_t*)calloc(1,
         sizeof(labeled_grid_geometry_t));
-    geometry->label = (char*)calloc(1, sizeof(char));
+    geometry->label = (char*)calloc(strlen(label) + 1, sizeof(char));
     geometry->geometry = (grid_geometry_t*)calloc(1, sizeof(grid_geometry_t));
 
     strcpy(geometry->label, label);
@@ -18,6 +18,14 @@ typedef struct {
     unsigned int width;
 } grid_geometry_t;
 
+/* Monitors left of or above the origin put frames at negative offsets */
+typedef struct {
+    int x;
+    int y;
+    unsigned int height;
+    unsigned int width;
+} pixel_geometry_t;
+
 typedef struct {
     grid_geometry_t *geometry;
     char *label;
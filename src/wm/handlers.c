@@ -1,5 +1,7 @@
 #include <stdlib.h>
+#include <sys/wait.h>
 #include <xcb/xcb.h>
+#include <xcb/xcb_event.h>
 
 #include "custard.h"
 #include "decorations.h"
@@ -7,25 +9,133 @@
 #include "window.h"
 
 #include "../xcb/connection.h"
+#include "../xcb/errors.h"
 #include "../xcb/ewmh.h"
 #include "../xcb/window.h"
 
 void (*xcb_events[])(xcb_generic_event_t*) = {
+    [0]                  = handle_error,
     [XCB_MAP_REQUEST]    = handle_map_request,
     [XCB_DESTROY_NOTIFY] = handle_window_close,
+    [XCB_CONFIGURE_NOTIFY] = handle_configure_notify,
+    [XCB_MAP_NOTIFY]     = handle_map_notify,
+    [XCB_UNMAP_NOTIFY]   = handle_unmap_notify,
     [XCB_CLIENT_MESSAGE] = handle_window_message,
     [XCB_BUTTON_PRESS]   = handle_window_click,
     [XCB_NO_OPERATION]   = NULL
 };
 
+/* What each window has to select for an event type to be delivered */
+static const event_selection_t event_selections[XCB_NO_OPERATION + 1] = {
+    /* Frames grab buttons themselves, see manage_window */
+    [XCB_BUTTON_PRESS]      = { XCB_EVENT_MASK_BUTTON_PRESS, 0, 0 },
+    [XCB_BUTTON_RELEASE]    = { XCB_EVENT_MASK_BUTTON_RELEASE, 0, 0 },
+    [XCB_MOTION_NOTIFY]     = { XCB_EVENT_MASK_POINTER_MOTION, 0, 0 },
+    [XCB_ENTER_NOTIFY]      = { 0, XCB_EVENT_MASK_ENTER_WINDOW, 0 },
+    [XCB_LEAVE_NOTIFY]      = { 0, XCB_EVENT_MASK_LEAVE_WINDOW, 0 },
+    [XCB_FOCUS_IN]          = { 0, 0, XCB_EVENT_MASK_FOCUS_CHANGE },
+    [XCB_FOCUS_OUT]         = { 0, 0, XCB_EVENT_MASK_FOCUS_CHANGE },
+    [XCB_EXPOSE]            = { 0, XCB_EVENT_MASK_EXPOSURE, 0 },
+    [XCB_CREATE_NOTIFY]     = { XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY, 0, 0 },
+    [XCB_DESTROY_NOTIFY]    = { XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY,
+        XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY, 0 },
+    [XCB_UNMAP_NOTIFY]      = { XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY,
+        XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY, 0 },
+    [XCB_MAP_NOTIFY]        = { XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY,
+        XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY, 0 },
+    [XCB_REPARENT_NOTIFY]   = { XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY,
+        XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY, 0 },
+    [XCB_CONFIGURE_NOTIFY]  = { XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY,
+        XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY, 0 },
+    [XCB_GRAVITY_NOTIFY]    = { XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY,
+        XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY, 0 },
+    [XCB_CIRCULATE_NOTIFY]  = { XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY,
+        XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY, 0 },
+    [XCB_MAP_REQUEST]       = { XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT, 0, 0 },
+    [XCB_CONFIGURE_REQUEST] = { XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT, 0, 0 },
+    [XCB_CIRCULATE_REQUEST] = { XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT, 0, 0 },
+    [XCB_PROPERTY_NOTIFY]   = { 0, 0, XCB_EVENT_MASK_PROPERTY_CHANGE },
+};
+
+unsigned int root_event_mask = 0;
+unsigned int frame_event_mask = 0;
+unsigned int client_event_mask = 0;
+
 void (*signals[])(int) = {
+    [SIGHUP]    = handle_reload_signal,
     [SIGINT]    = handle_termination_signal,
+    [SIGUSR1]   = handle_diagnostics_signal,
     [SIGTERM]   = handle_termination_signal,
+    [SIGCHLD]   = handle_child_signal,
     [SIGUNUSED] = NULL
 };
 
+void setup_event_masks() {
+    /*
+     * Nothing is selected unless something handles it. The handlers are
+     * fixed, so this runs once before any window is managed.
+     */
+    root_event_mask = XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT;
+    frame_event_mask = 0;
+    client_event_mask = 0;
+
+    for (unsigned int type = 0; type < XCB_NO_OPERATION; type++) {
+        if (!xcb_events[type])
+            continue;
+
+        root_event_mask |= event_selections[type].root;
+        frame_event_mask |= event_selections[type].frame;
+        client_event_mask |= event_selections[type].client;
+    }
+
+    change_window_attributes(xcb_screen->root, XCB_CW_EVENT_MASK,
+        &root_event_mask);
+}
+
 /* XCB event handlers */
 
+void handle_error(xcb_generic_event_t *generic_event) {
+    xcb_generic_error_t *error;
+    error = (xcb_generic_error_t*)generic_event;
+
+    tracked_request_t *request = find_tracked_request(error->sequence);
+
+    const char *request_name = request ? request->request :
+        xcb_event_get_request_label(error->major_code);
+    xcb_window_t window_id = request ? request->window : error->resource_id;
+
+    if (error->error_code != XCB_WINDOW) {
+        log_message("%s from %s on window(%08x)",
+            xcb_event_get_error_label(error->error_code), request_name,
+            window_id);
+        return;
+    }
+
+    /* The window went away before the request reached the server */
+    log_debug("Window(%08x) vanished during %s", error->resource_id,
+        request_name);
+
+    window_t *window;
+    if (windows) {
+        for (unsigned int index = 0; index < windows->size; index++) {
+            window = get_from_vector(windows, index);
+
+            if (window->id == error->resource_id ||
+                window->parent == error->resource_id) {
+                if (focused_window == window->id)
+                    focused_window = XCB_WINDOW_NONE;
+                unmanage_window(window->id);
+                break;
+            }
+        }
+    }
+
+    if (focused_window == error->resource_id)
+        focused_window = XCB_WINDOW_NONE;
+
+    forget_window(error->resource_id);
+}
+
 void handle_map_request(xcb_generic_event_t *generic_event) {
     xcb_map_request_event_t *event;
     event = (xcb_map_request_event_t*)generic_event;
@@ -35,6 +145,8 @@ void handle_map_request(xcb_generic_event_t *generic_event) {
     xcb_window_t previously_focused_window = focused_window;
     focused_window = window_id;
 
+    /* A map request is only ever sent for an unmapped window */
+    note_window_map_state(window_id, WINDOW_UNMAP, event->sequence);
     map_window(window_id);
 
     window_t *window = NULL;
@@ -51,16 +163,8 @@ void handle_map_request(xcb_generic_event_t *generic_event) {
 
     if (window_is_managed(previously_focused_window)) {
         window = get_window_by_id(previously_focused_window);
-        xcb_grab_button(xcb_connection, 0, previously_focused_window,
-            XCB_EVENT_MASK_BUTTON_PRESS,
-            XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC,
-            XCB_NONE, XCB_NONE,
-            XCB_BUTTON_INDEX_ANY ^ XCB_BUTTON_INDEX_4 ^ XCB_BUTTON_INDEX_5,
-            XCB_MOD_MASK_ANY);
         decorate(window);
     }
-
-    apply();
 }
 
 void handle_window_close(xcb_generic_event_t *generic_event) {
@@ -76,7 +180,31 @@ void handle_window_close(xcb_generic_event_t *generic_event) {
     if (focused_window == window_id)
         focused_window = XCB_WINDOW_NONE;
 
-    apply();
+    forget_window(window_id);
+}
+
+void handle_configure_notify(xcb_generic_event_t *generic_event) {
+    xcb_configure_notify_event_t *event;
+    event = (xcb_configure_notify_event_t*)generic_event;
+
+    /* Clients may resize themselves within their frames */
+    note_window_geometry(event->window, (unsigned int)event->x,
+        (unsigned int)event->y, event->width, event->height,
+        event->border_width, event->sequence);
+}
+
+void handle_map_notify(xcb_generic_event_t *generic_event) {
+    xcb_map_notify_event_t *event;
+    event = (xcb_map_notify_event_t*)generic_event;
+
+    note_window_map_state(event->window, WINDOW_MAP, event->sequence);
+}
+
+void handle_unmap_notify(xcb_generic_event_t *generic_event) {
+    xcb_unmap_notify_event_t *event;
+    event = (xcb_unmap_notify_event_t*)generic_event;
+
+    note_window_map_state(event->window, WINDOW_UNMAP, event->sequence);
 }
 
 void handle_window_message(xcb_generic_event_t *generic_event) {
@@ -86,9 +214,10 @@ void handle_window_message(xcb_generic_event_t *generic_event) {
     xcb_window_t window_id = event->window;
 
     if (event->type == ewmh_connection->_NET_CLOSE_WINDOW) {
-        if (window_is_managed(window_id))
-            unmanage_window(window_id);
-        close_window(window_id);
+        /* The frame is torn down once the client's DestroyNotify arrives */
+        window_t *window = get_window_by_id(window_id);
+        close_window(window_id, window ? window->protocols : 0);
+
         return;
     }
 
@@ -109,15 +238,21 @@ void handle_window_message(xcb_generic_event_t *generic_event) {
             monitor_t *monitor = window->monitor;
 
             if (window->fullscreen) {
+                window->frame_geometry.x = (int)monitor->geometry->x;
+                window->frame_geometry.y = (int)monitor->geometry->y;
+                window->frame_geometry.height =
+                    (unsigned int)monitor->geometry->height;
+                window->frame_geometry.width =
+                    (unsigned int)monitor->geometry->width;
+
                 change_window_geometry(window->parent,
-                    0, 0,
-                    (unsigned int)monitor->geometry->height,
-                    (unsigned int)monitor->geometry->width
+                    window->frame_geometry.x,
+                    window->frame_geometry.y,
+                    window->frame_geometry.height,
+                    window->frame_geometry.width
                 );
             } else
                 set_window_geometry(window, window->geometry);
-
-            apply();
         }
 
         return;
@@ -132,6 +267,14 @@ void handle_window_click(xcb_generic_event_t *generic_event) {
     xcb_window_t window_id = event->event;
     log_debug("Window(%08x) clicked", window_id);
 
+    /* Frames grab clicks synchronously; the click is handed on to the
+     * client once focus has been settled. */
+    replay_pointer(event->time);
+
+    /* Scrolling over a window does not focus it */
+    if (event->detail >= 4 && event->detail <= 7)
+        return;
+
     window_t *window;
     if (windows) {
         while ((window = vector_iterator(windows))) {
@@ -154,8 +297,6 @@ void handle_window_click(xcb_generic_event_t *generic_event) {
     /* Is the newly focused window managed? */
     if (window_is_managed(focused_window)) {
         window = get_window_by_id(focused_window);
-        xcb_ungrab_button(xcb_connection,
-            XCB_BUTTON_INDEX_ANY, window_id, XCB_MOD_MASK_ANY);
         raise_window(window->parent);
         decorate(window);
     } else {
@@ -166,16 +307,8 @@ void handle_window_click(xcb_generic_event_t *generic_event) {
     /* Is the previously focused window managed? */
     if (window_is_managed(previous_window)) {
         window = get_window_by_id(previous_window);
-        xcb_grab_button(xcb_connection, 0, previous_window,
-            XCB_EVENT_MASK_BUTTON_PRESS,
-            XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC,
-            XCB_NONE, XCB_NONE,
-            XCB_BUTTON_INDEX_ANY ^ XCB_BUTTON_INDEX_4 ^ XCB_BUTTON_INDEX_5,
-            XCB_MOD_MASK_ANY);
         decorate(window);
     }
-
-    apply();
 }
 
 /* Signal handlers */
@@ -186,13 +319,28 @@ void handle_termination_signal(int signal) {
     else
         log_message("SIGTERM received");
 
+    /* The loop finishes its iteration and finalizes on the way out */
     custard_is_running = 0;
+}
+
+void handle_child_signal(int signal) {
+    suppress_unused(signal);
+
+    /* One SIGCHLD may stand for several children */
+    pid_t child;
+    while ((child = waitpid(-1, NULL, WNOHANG)) > 0)
+        log_debug("Child(%d) reaped", child);
+}
 
-    /* The window manager won't die until the next iteration of the loop,
-     * so let's just force it to close. */
+void handle_reload_signal(int signal) {
+    suppress_unused(signal);
 
-    finalize();
-    exit(EXIT_SUCCESS);
+    log_message("SIGHUP received, reloading configuration");
+    run_rc();
 }
 
-// TODO: handle more signals?
+void handle_diagnostics_signal(int signal) {
+    suppress_unused(signal);
+
+    dump_diagnostics();
+}
@@ -10,8 +10,27 @@
 extern void (*xcb_events[XCB_NO_OPERATION + 1])(xcb_generic_event_t*);
 extern void (*signals[SIGUNUSED + 1])(int);
 
+typedef struct {
+    unsigned int root;
+    unsigned int frame;
+    unsigned int client;
+} event_selection_t;
+
+extern unsigned int root_event_mask;
+extern unsigned int frame_event_mask;
+extern unsigned int client_event_mask;
+
+void setup_event_masks(void);
+
+void handle_error(xcb_generic_event_t*);
 void handle_map_request(xcb_generic_event_t*);
 void handle_window_close(xcb_generic_event_t*);
+void handle_configure_notify(xcb_generic_event_t*);
+void handle_map_notify(xcb_generic_event_t*);
+void handle_unmap_notify(xcb_generic_event_t*);
 void handle_window_click(xcb_generic_event_t*);
 void handle_window_message(xcb_generic_event_t*);
 void handle_termination_signal(int);
+void handle_child_signal(int);
+void handle_reload_signal(int);
+void handle_diagnostics_signal(int);
@@ -0,0 +1,88 @@
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "custard.h"
+#include "events.h"
+#include "latency.h"
+
+#include "../xcb/window.h"
+
+#ifndef SCHED_RESET_ON_FORK
+#define SCHED_RESET_ON_FORK 0x40000000
+#endif
+
+latency_mode_t latency_mode = LATENCY_NORMAL;
+int latency_priority = 0;
+
+unsigned short set_latency_mode(char *mode) {
+    if (!strcmp(mode, "nice"))
+        latency_mode = LATENCY_NICE;
+    else if (!strcmp(mode, "fifo"))
+        latency_mode = LATENCY_FIFO;
+    else if (!strcmp(mode, "rr"))
+        latency_mode = LATENCY_RR;
+    else
+        return 0;
+
+    return 1;
+}
+
+void latency_priority_range(int *minimum, int *maximum) {
+    /* Nice values for nice, scheduler priorities otherwise */
+    if (latency_mode == LATENCY_NICE) {
+        *minimum = PRIO_MIN;
+        *maximum = PRIO_MAX - 1;
+    } else if (latency_mode != LATENCY_NORMAL) {
+        int policy = (latency_mode == LATENCY_FIFO) ? SCHED_FIFO : SCHED_RR;
+        *minimum = sched_get_priority_min(policy);
+        *maximum = sched_get_priority_max(policy);
+    } else
+        *minimum = *maximum = 0;
+}
+
+void enter_low_latency_mode() {
+    if (latency_mode == LATENCY_NORMAL)
+        return;
+
+    /* Grow everything the event loop touches up front; together with
+     * locked memory nothing on the hot path faults or reallocates */
+    reserve_window_states(RESERVED_WINDOWS);
+    reserve_events(RESERVED_EVENTS);
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+        log_message("Unable to lock memory: %s", strerror(errno));
+
+    if (latency_mode == LATENCY_NICE) {
+        if (!latency_priority)
+            latency_priority = -10;
+
+        if (setpriority(PRIO_PROCESS, 0, latency_priority) < 0)
+            log_message("Unable to set nice value %d: %s", latency_priority,
+                strerror(errno));
+    } else {
+        if (!latency_priority)
+            latency_priority = 10;
+
+        /* Children such as the rc go back to normal scheduling */
+        struct sched_param parameters = {
+            .sched_priority = latency_priority
+        };
+        int policy = (latency_mode == LATENCY_FIFO) ? SCHED_FIFO : SCHED_RR;
+
+        if (sched_setscheduler(0, policy | SCHED_RESET_ON_FORK,
+            &parameters) < 0)
+            log_message("Unable to set real-time priority %d: %s",
+                latency_priority, strerror(errno));
+    }
+
+    log_debug("Low latency mode entered");
+}
+
+void leave_low_latency_mode() {
+    /* For forked children; a raised nice value is not reset on fork */
+    if (latency_mode == LATENCY_NICE)
+        setpriority(PRIO_PROCESS, 0, 0);
+}
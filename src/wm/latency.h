@@ -0,0 +1,20 @@
+#pragma once
+
+/* Capacity preallocated by --low-latency so the hot path does not grow */
+#define RESERVED_WINDOWS 256
+#define RESERVED_EVENTS 1024
+
+typedef enum {
+    LATENCY_NORMAL = 0,
+    LATENCY_NICE,
+    LATENCY_FIFO,
+    LATENCY_RR
+} latency_mode_t;
+
+extern latency_mode_t latency_mode;
+extern int latency_priority;
+
+unsigned short set_latency_mode(char*);
+void latency_priority_range(int*, int*);
+void enter_low_latency_mode(void);
+void leave_low_latency_mode(void);
@@ -2,15 +2,18 @@
 #include <string.h>
 #include <xcb/randr.h>
 
+#include "custard.h"
 #include "geometry.h"
 #include "monitor.h"
 
 #include "../vector.h"
 
 #include "../xcb/connection.h"
+#include "../xcb/statistics.h"
 #include "../xcb/xrandr.h"
 
 vector_t *monitors = NULL;
+monitor_index_t *monitor_index = NULL;
 
 void setup_monitors() {
     monitors = construct_vector();
@@ -33,29 +36,49 @@ void setup_monitors() {
         strcpy(monitor->name, "<xorg>");
         push_to_vector(monitors, monitor);
 
+        build_monitor_index();
         return;
     }
 
     xcb_randr_get_monitors_reply_t *outputs = get_xrandr_outputs();
 
     xcb_randr_monitor_info_iterator_t iterator;
+    xcb_randr_monitor_info_t *monitor_information;
+
+    /* Every name is asked for before waiting on the first one */
+    unsigned int count = xcb_randr_get_monitors_monitors_length(outputs);
+    xcb_get_atom_name_cookie_t *cookies = (xcb_get_atom_name_cookie_t*)
+        calloc(count ? count : 1, sizeof(xcb_get_atom_name_cookie_t));
+
     iterator = xcb_randr_get_monitors_monitors_iterator(outputs);
+    for (unsigned int index = 0; iterator.rem; index++) {
+        cookies[index] = xcb_get_atom_name(xcb_connection,
+            iterator.data->name);
+        xcb_randr_monitor_info_next(&iterator);
+    }
 
-    xcb_randr_monitor_info_t *monitor_information;
-    char *output_name;
+    xcb_get_atom_name_reply_t *name_reply;
+    unsigned int name_length;
 
-    while (iterator.rem) {
+    iterator = xcb_randr_get_monitors_monitors_iterator(outputs);
+    for (unsigned int index = 0; iterator.rem; index++) {
         monitor = (monitor_t*)calloc(1, sizeof(monitor_t));
-        monitor->name = (char*)calloc(1, sizeof(char));
         monitor->geometry = (screen_geometry_t*)calloc(1,
             sizeof(screen_geometry_t));
         monitor->configuration = NULL;
 
         monitor_information = iterator.data;
-        output_name = xcb_get_atom_name_name(
-            xcb_get_atom_name_reply(xcb_connection,
-                xcb_get_atom_name(xcb_connection, monitor_information->name),
-            NULL));
+        round_trip(name_reply = xcb_get_atom_name_reply(xcb_connection,
+            cookies[index], NULL));
+
+        /* Atom names are not NUL-terminated on the wire */
+        name_length = name_reply ?
+            xcb_get_atom_name_name_length(name_reply) : 0;
+        monitor->name = (char*)calloc(name_length + 1, sizeof(char));
+        if (name_reply)
+            memcpy(monitor->name, xcb_get_atom_name_name(name_reply),
+                name_length);
+        free(name_reply);
 
         monitor->geometry->x = (float)monitor_information->x;
         monitor->geometry->y = (float)monitor_information->y;
@@ -66,11 +89,131 @@ void setup_monitors() {
         monitor->geometries = NULL;
         monitor->workspace = 1;
 
-        strcpy(monitor->name, output_name);
         push_to_vector(monitors, monitor);
 
         xcb_randr_monitor_info_next(&iterator);
     }
+
+    free(cookies);
+
+    build_monitor_index();
+}
+
+static int compare_edges(const void *a, const void *b) {
+    return *(const int*)a - *(const int*)b;
+}
+
+static unsigned int unique_edges(int *edges, unsigned int length) {
+    qsort(edges, length, sizeof(int), compare_edges);
+
+    unsigned int unique = 0;
+    for (unsigned int index = 0; index < length; index++)
+        if (!unique || edges[unique - 1] != edges[index])
+            edges[unique++] = edges[index];
+
+    return unique;
+}
+
+static int find_edge(int *edges, unsigned int length, int value) {
+    /* Index of the cell (edges[i], edges[i + 1]) holding value, or -1 */
+
+    if (length < 2 || value < edges[0] || value >= edges[length - 1])
+        return -1;
+
+    unsigned int low = 0;
+    unsigned int high = length - 1;
+
+    while (high - low > 1) {
+        unsigned int middle = (low + high) / 2;
+
+        if (edges[middle] <= value)
+            low = middle;
+        else
+            high = middle;
+    }
+
+    return (int)low;
+}
+
+void build_monitor_index() {
+    /*
+     * Monitors are cut into a grid along every distinct monitor edge, so
+     * that each cell is covered by at most one monitor (the first listed,
+     * for mirrored outputs) or by none at all (gaps between outputs).
+     * A point is then resolved with a binary search on each axis.
+     */
+
+    free_monitor_index();
+
+    if (!monitors || !monitors->size)
+        return;
+
+    unsigned int length = monitors->size * 2;
+
+    monitor_index = (monitor_index_t*)calloc(1, sizeof(monitor_index_t));
+    monitor_index->x_edges = (int*)calloc(length, sizeof(int));
+    monitor_index->y_edges = (int*)calloc(length, sizeof(int));
+
+    monitor_t *monitor;
+    unsigned int index;
+    for (index = 0; index < monitors->size; index++) {
+        monitor = get_from_vector(monitors, index);
+
+        monitor_index->x_edges[index * 2] = (int)monitor->geometry->x;
+        monitor_index->x_edges[index * 2 + 1] = (int)(monitor->geometry->x +
+            monitor->geometry->width);
+        monitor_index->y_edges[index * 2] = (int)monitor->geometry->y;
+        monitor_index->y_edges[index * 2 + 1] = (int)(monitor->geometry->y +
+            monitor->geometry->height);
+    }
+
+    monitor_index->columns = unique_edges(monitor_index->x_edges, length);
+    monitor_index->rows = unique_edges(monitor_index->y_edges, length);
+
+    if (monitor_index->columns < 2 || monitor_index->rows < 2)
+        return;
+
+    unsigned int columns = monitor_index->columns - 1;
+    unsigned int rows = monitor_index->rows - 1;
+
+    monitor_index->cells = (monitor_t**)calloc(columns * rows,
+        sizeof(monitor_t*));
+
+    int x, y;
+    unsigned int column, row;
+    for (row = 0; row < rows; row++) {
+        y = monitor_index->y_edges[row];
+
+        for (column = 0; column < columns; column++) {
+            x = monitor_index->x_edges[column];
+
+            for (index = 0; index < monitors->size; index++) {
+                monitor = get_from_vector(monitors, index);
+
+                if (x >= (int)monitor->geometry->x &&
+                    y >= (int)monitor->geometry->y &&
+                    x < (int)(monitor->geometry->x + monitor->geometry->width) &&
+                    y < (int)(monitor->geometry->y + monitor->geometry->height)) {
+                    monitor_index->cells[row * columns + column] = monitor;
+                    break;
+                }
+            }
+        }
+    }
+
+    log_debug("Monitor index built (%dx%d cells)", columns, rows);
+}
+
+void free_monitor_index() {
+    if (!monitor_index)
+        return;
+
+    free(monitor_index->x_edges);
+    free(monitor_index->y_edges);
+    free(monitor_index->cells);
+    free(monitor_index);
+
+    monitor_index = NULL;
 }
 
 monitor_t *monitor_from_name(char *name) {
@@ -85,26 +228,84 @@ monitor_t *monitor_from_name(char *name) {
     return NULL;
 }
 
-monitor_t *monitor_with_cursor_residence() {
-    xcb_query_pointer_cookie_t pointer_cookie;
-    pointer_cookie = xcb_query_pointer(xcb_connection, xcb_screen->root);
+monitor_t *monitor_at_point(int x, int y) {
+    if (!monitor_index || !monitor_index->cells)
+        return NULL;
 
-    xcb_query_pointer_reply_t *pointer = xcb_query_pointer_reply(xcb_connection,
-        pointer_cookie, NULL);
+    int column = find_edge(monitor_index->x_edges, monitor_index->columns, x);
+    int row = find_edge(monitor_index->y_edges, monitor_index->rows, y);
 
-    float x = 0;
-    float y = 0;
+    if (column < 0 || row < 0)
+        return NULL;
+
+    return monitor_index->cells[(unsigned int)row *
+        (monitor_index->columns - 1) + (unsigned int)column];
+}
+
+monitor_t *monitor_containing_geometry(screen_geometry_t *geometry) {
+    /* The monitor holding the center of the geometry wins */
+
+    monitor_t *monitor = monitor_at_point(
+        (int)(geometry->x + (geometry->width / 2)),
+        (int)(geometry->y + (geometry->height / 2)));
+
+    if (monitor)
+        return monitor;
+
+    /* Center falls in a gap; settle for the largest overlap */
+
+    monitor_t *candidate;
+    float overlap, largest_overlap = 0;
+    float left, right, top, bottom;
+    float horizontal, vertical;
 
-    monitor_t *monitor;
     for (unsigned int index = 0; index < monitors->size; index++) {
-        monitor = get_from_vector(monitors, index);
+        candidate = get_from_vector(monitors, index);
 
-        x += monitor->geometry->width;
-        y += monitor->geometry->height;
+        left = geometry->x > candidate->geometry->x ?
+            geometry->x : candidate->geometry->x;
+        top = geometry->y > candidate->geometry->y ?
+            geometry->y : candidate->geometry->y;
+        right = geometry->x + geometry->width;
+        if (candidate->geometry->x + candidate->geometry->width < right)
+            right = candidate->geometry->x + candidate->geometry->width;
+        bottom = geometry->y + geometry->height;
+        if (candidate->geometry->y + candidate->geometry->height < bottom)
+            bottom = candidate->geometry->y + candidate->geometry->height;
 
-        if (pointer->root_x < x && pointer->root_y < y)
-            return monitor;
+        horizontal = right - left;
+        vertical = bottom - top;
+
+        if (horizontal <= 0 || vertical <= 0)
+            continue;
+
+        overlap = horizontal * vertical;
+        if (overlap > largest_overlap) {
+            largest_overlap = overlap;
+            monitor = candidate;
+        }
     }
 
-    return NULL;
+    return monitor;
+}
+
+monitor_t *monitor_with_cursor_residence() {
+    xcb_query_pointer_cookie_t pointer_cookie;
+    pointer_cookie = xcb_query_pointer(xcb_connection, xcb_screen->root);
+
+    xcb_query_pointer_reply_t *pointer;
+    round_trip(pointer = xcb_query_pointer_reply(xcb_connection,
+        pointer_cookie, NULL));
+
+    monitor_t *monitor = NULL;
+    if (pointer) {
+        monitor = monitor_at_point(pointer->root_x, pointer->root_y);
+        free(pointer);
+    }
+
+    /* Pointer is between outputs; fall back to the first monitor */
+    if (!monitor)
+        monitor = get_from_vector(monitors, 0);
+
+    return monitor;
 }
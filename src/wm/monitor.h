@@ -6,6 +6,16 @@
 
 extern vector_t *monitors;
 
+typedef struct {
+    int *x_edges;
+    int *y_edges;
+    unsigned int columns;
+    unsigned int rows;
+    monitor_t **cells;
+} monitor_index_t;
+
+extern monitor_index_t *monitor_index;
+
 struct monitor {
     char *name;
     screen_geometry_t *geometry;
@@ -15,5 +25,9 @@ struct monitor {
 };
 
 void setup_monitors(void);
+void build_monitor_index(void);
+void free_monitor_index(void);
 monitor_t *monitor_from_name(char*);
+monitor_t *monitor_at_point(int, int);
+monitor_t *monitor_containing_geometry(screen_geometry_t*);
 monitor_t *monitor_with_cursor_residence(void);
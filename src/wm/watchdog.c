@@ -0,0 +1,167 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <xcb/xcb_event.h>
+
+#include "custard.h"
+#include "watchdog.h"
+
+/*
+ * Optional thread that notices when one iteration of the event loop runs
+ * longer than watchdog_threshold milliseconds, and records what the loop
+ * was doing at the time. The loop only ever stores into atomics; context
+ * names must outlive the iteration they are noted in.
+ */
+
+unsigned int watchdog_threshold = 0;
+unsigned int stalls_detected = 0;
+
+static pthread_t watchdog_thread;
+static pthread_mutex_t report_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_ushort watchdog_is_running = 0;
+
+static atomic_ulong iteration_start = 0; /* 0 while poll is waiting */
+static atomic_ulong iteration = 0;
+static _Atomic(const char*) current_context = NULL;
+static atomic_uchar current_event_type = 0;
+static atomic_uint current_window = 0;
+
+static unsigned long reported_iteration = 0;
+static stall_report_t report;
+
+static unsigned long now_in_milliseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (unsigned long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void *watch(void *unused) {
+    suppress_unused(unused);
+
+    /* Look a few times per threshold, but no more than every millisecond */
+    unsigned int period = watchdog_threshold < 4 ? 1 : watchdog_threshold / 4;
+    struct timespec interval = {
+        .tv_sec = period / 1000,
+        .tv_nsec = (period % 1000) * 1000000L
+    };
+
+    unsigned long start, current;
+    const char *context;
+    stall_report_t stall;
+
+    while (watchdog_is_running) {
+        nanosleep(&interval, NULL);
+
+        start = iteration_start;
+        current = iteration;
+
+        if (!start || current == reported_iteration ||
+            now_in_milliseconds() - start < watchdog_threshold)
+            continue;
+
+        context = current_context;
+
+        pthread_mutex_lock(&report_lock);
+        reported_iteration = current;
+        stalls_detected++;
+
+        snprintf(report.context, sizeof(report.context), "%s",
+            context ? context : "loop");
+        report.event_type = current_event_type;
+        report.window = current_window;
+        report.duration = now_in_milliseconds() - start;
+        report.finished = 0;
+        stall = report;
+        pthread_mutex_unlock(&report_lock);
+
+        log_message("Event loop stalled for %lums in %s (%s, window %08x)",
+            stall.duration, stall.context,
+            stall.event_type ? xcb_event_get_label(stall.event_type) : "-",
+            stall.window);
+    }
+
+    return NULL;
+}
+
+unsigned short start_watchdog() {
+    if (!watchdog_threshold)
+        return 1;
+
+    watchdog_is_running = 1;
+    if (pthread_create(&watchdog_thread, NULL, watch, NULL)) {
+        watchdog_is_running = 0;
+        log_fatal("Unable to start watchdog");
+        return 0;
+    }
+
+    log_debug("Watchdog started with a %dms threshold", watchdog_threshold);
+
+    return 1;
+}
+
+void stop_watchdog() {
+    if (!watchdog_is_running)
+        return;
+
+    watchdog_is_running = 0;
+    pthread_join(watchdog_thread, NULL);
+}
+
+void watchdog_begin_iteration() {
+    if (!watchdog_is_running)
+        return;
+
+    iteration++;
+    current_context = NULL;
+    current_event_type = 0;
+    current_window = 0;
+    iteration_start = now_in_milliseconds();
+}
+
+void watchdog_note(const char *context, unsigned char event_type,
+    xcb_window_t window_id) {
+    if (!watchdog_is_running)
+        return;
+
+    current_context = context;
+    current_event_type = event_type;
+    current_window = window_id;
+}
+
+void watchdog_end_iteration() {
+    if (!watchdog_is_running)
+        return;
+
+    unsigned long start = iteration_start;
+    iteration_start = 0;
+
+    pthread_mutex_lock(&report_lock);
+    if (reported_iteration == iteration) {
+        report.duration = now_in_milliseconds() - start;
+        report.finished = 1;
+        log_message("Stall in %s ended after %lums", report.context,
+            report.duration);
+    }
+    pthread_mutex_unlock(&report_lock);
+}
+
+char *format_stall_report() {
+    char *output = (char*)calloc(256, sizeof(char));
+
+    pthread_mutex_lock(&report_lock);
+    if (!stalls_detected)
+        snprintf(output, 256, "stalls 0\n");
+    else
+        snprintf(output, 256, "stalls %u\ncontext %s\nevent %s\n"
+            "window %08x\nduration %lu%s\n", stalls_detected, report.context,
+            report.event_type ? xcb_event_get_label(report.event_type) : "-",
+            report.window, report.duration,
+            report.finished ? "" : " (ongoing)");
+    pthread_mutex_unlock(&report_lock);
+
+    return output;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <xcb/xcb.h>
+
+typedef struct {
+    char context[64];
+    unsigned char event_type;
+    xcb_window_t window;
+    unsigned long duration; /* milliseconds */
+    unsigned short finished;
+} stall_report_t;
+
+extern unsigned int watchdog_threshold;
+extern unsigned int stalls_detected;
+
+unsigned short start_watchdog(void);
+void stop_watchdog(void);
+
+void watchdog_begin_iteration(void);
+void watchdog_note(const char*, unsigned char, xcb_window_t);
+void watchdog_end_iteration(void);
+
+char *format_stall_report(void);
@@ -1,10 +1,13 @@
+#include <stdlib.h>
 #include <string.h>
 
 #include "config.h"
 #include "custard.h"
 #include "decorations.h"
+#include "events.h"
 #include "geometry.h"
 #include "grid.h"
+#include "handlers.h"
 #include "monitor.h"
 #include "rules.h"
 #include "window.h"
@@ -12,12 +15,18 @@
 #include "../vector.h"
 
 #include "../xcb/connection.h"
+#include "../xcb/errors.h"
 #include "../xcb/ewmh.h"
+#include "../xcb/statistics.h"
 #include "../xcb/window.h"
 
 vector_t *windows = NULL;
 xcb_window_t focused_window = XCB_WINDOW_NONE;
 
+static xcb_window_t *relayout_queue = NULL;
+static unsigned int relayout_size = 0;
+static unsigned int relayout_next = 0;
+
 unsigned short window_should_be_managed(xcb_window_t window_id) {
     if (window_id == xcb_screen->root || window_id == ewmh_window ||
         window_id == XCB_WINDOW_NONE) return 0;
@@ -28,8 +37,8 @@ unsigned short window_should_be_managed(xcb_window_t window_id) {
         window_id);
 
     xcb_get_window_attributes_reply_t *attributes;
-    attributes = xcb_get_window_attributes_reply(xcb_connection,
-        window_attributes_cookie, NULL);
+    round_trip(attributes = xcb_get_window_attributes_reply(xcb_connection,
+        window_attributes_cookie, NULL));
 
     if (attributes && attributes->override_redirect) return 0;
 
@@ -38,8 +47,11 @@ unsigned short window_should_be_managed(xcb_window_t window_id) {
     window_type_cookie = xcb_ewmh_get_wm_window_type(ewmh_connection,
         window_id);
 
-    if (xcb_ewmh_get_wm_window_type_reply(ewmh_connection, window_type_cookie,
-        &window_type, NULL)) {
+    unsigned char has_window_type;
+    round_trip(has_window_type = xcb_ewmh_get_wm_window_type_reply(
+        ewmh_connection, window_type_cookie, &window_type, NULL));
+
+    if (has_window_type) {
         xcb_atom_t atom;
 
         for (unsigned int index = 0; index < window_type.atoms_len; index++) {
@@ -102,14 +114,23 @@ window_t *manage_window(xcb_window_t window_id) {
     window->fullscreen = window->floating = 0;
     window->parent = xcb_generate_id(xcb_connection);
 
+    /* Both replies come back on a single round trip */
+    xcb_get_property_cookie_t protocols_cookie, class_cookie;
+    protocols_cookie = request_protocols_of_window(window_id);
+    class_cookie = request_class_of_window(window_id);
+    round_trip(
+        window->protocols = protocols_from_reply(protocols_cookie);
+        window->class = class_from_reply(class_cookie, &window->instance));
+
     window->rule = NULL;
     if (rules) {
         rule_t *rule;
         char *subject;
 
         while ((rule = vector_iterator(rules))) {
+            /* Class rules have always matched the instance */
             if (rule->attribute == class)
-                subject = class_of_window(window_id);
+                subject = window->instance ? window->instance : "";
             else
                 subject = name_of_window(window_id);
 
@@ -161,32 +182,41 @@ window_t *manage_window(xcb_window_t window_id) {
     /* Parent window creation */
 
     unsigned int values[] = {
-        0, 0, 1, screen_colormap
+        0, 0, 1, frame_event_mask, screen_colormap
     };
     unsigned int masked_values = XCB_CW_BACK_PIXEL |
-        XCB_CW_BORDER_PIXEL | XCB_CW_OVERRIDE_REDIRECT | XCB_CW_COLORMAP;
+        XCB_CW_BORDER_PIXEL | XCB_CW_OVERRIDE_REDIRECT | XCB_CW_EVENT_MASK |
+        XCB_CW_COLORMAP;
 
-    xcb_create_window(xcb_connection, 32,
+    xcb_void_cookie_t cookie;
+    cookie = xcb_create_window(xcb_connection, 32,
         window->parent, xcb_screen->root,
         0, 0, 1, 1,
         0 /* border size */,
         XCB_WINDOW_CLASS_INPUT_OUTPUT, screen_visual->visual_id,
         masked_values, values);
+    track_request(cookie.sequence, "CreateWindow", window->parent);
+    forget_stacking();
 
-    values[0] = XCB_EVENT_MASK_BUTTON_PRESS |
-        XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY;
-    masked_values = XCB_CW_EVENT_MASK;
+    if (client_event_mask)
+        change_window_attributes(window_id, XCB_CW_EVENT_MASK,
+            &client_event_mask);
 
-    xcb_change_window_attributes(xcb_connection,
-        window->parent, masked_values, values);
+    /* One synchronous grab for the frame's lifetime; every click is
+     * replayed to the client after it has been used to focus. */
+    xcb_grab_button(xcb_connection, 0, window->parent,
+        XCB_EVENT_MASK_BUTTON_PRESS,
+        XCB_GRAB_MODE_SYNC, XCB_GRAB_MODE_ASYNC,
+        XCB_NONE, XCB_NONE, XCB_BUTTON_INDEX_ANY, XCB_MOD_MASK_ANY);
 
     /* Finalization */
 
     if (!windows)
         windows = construct_vector();
 
-    xcb_reparent_window(xcb_connection,
+    cookie = xcb_reparent_window(xcb_connection,
         window_id, window->parent, 0, 0);
+    track_request(cookie.sequence, "ReparentWindow", window_id);
     set_window_geometry(window, geometry);
 
     if (window->monitor->workspace == window->workspace)
@@ -200,13 +230,20 @@ window_t *manage_window(xcb_window_t window_id) {
 
 void unmanage_window(xcb_window_t window_id) {
     window_t *window;
-    for (unsigned int index = 0; index < windows->size; index++) {
+    for (unsigned int index = 0; windows && index < windows->size; index++) {
         window = get_from_vector(windows, index);
 
         if (window->id == window_id) {
 
             pull_from_vector(windows, index);
-            xcb_destroy_window(xcb_connection, window->parent);
+            release_window_decorations(window);
+            /* The strips go with the frame but their state must not */
+            destroy_border_strips(window);
+            track_request(xcb_destroy_window(xcb_connection,
+                window->parent).sequence, "DestroyWindow", window->parent);
+            forget_window(window->parent);
+            free(window->class);
+            free(window->instance);
             free(window);
 
             log_debug("Window(%08x) unmanaged", window_id);
@@ -215,11 +252,79 @@ void unmanage_window(xcb_window_t window_id) {
     }
 }
 
+void schedule_relayout() {
+    cancel_relayout();
+
+    if (!windows || !windows->size)
+        return;
+
+    relayout_queue = (xcb_window_t*)calloc(windows->size,
+        sizeof(xcb_window_t));
+
+    /* Visible windows on the focused monitor, then visible windows
+     * elsewhere, then hidden workspaces */
+    monitor_t *focused_monitor = monitor_with_cursor_residence();
+
+    window_t *window;
+    unsigned int rank;
+    for (unsigned int pass = 0; pass < 3; pass++) {
+        for (unsigned int index = 0; index < windows->size; index++) {
+            window = get_from_vector(windows, index);
+
+            if (window->workspace != window->monitor->workspace)
+                rank = 2;
+            else
+                rank = window->monitor != focused_monitor;
+
+            if (rank == pass)
+                relayout_queue[relayout_size++] = window->id;
+        }
+    }
+
+    log_debug("Relayout of %d windows scheduled", relayout_size);
+}
+
+unsigned short relayout_is_pending() {
+    return relayout_next < relayout_size;
+}
+
+void continue_relayout(struct timespec *deadline) {
+    window_t *window;
+    unsigned int chunk = 0;
+
+    /* Windows unmanaged since scheduling are skipped */
+    while (relayout_next < relayout_size) {
+        if (chunk && deadline && deadline_has_passed(deadline))
+            break;
+
+        window = get_window_by_id(relayout_queue[relayout_next++]);
+        if (!window)
+            continue;
+
+        set_window_geometry(window, window->geometry);
+        decorate(window);
+        chunk++;
+    }
+
+    log_debug("Relayout of %d windows, %d remaining", chunk,
+        relayout_size - relayout_next);
+
+    if (!relayout_is_pending())
+        cancel_relayout();
+}
+
+void cancel_relayout() {
+    free(relayout_queue);
+    relayout_queue = NULL;
+    relayout_size = relayout_next = 0;
+}
+
 void set_window_geometry(window_t *window, void *geometry) {
     window->geometry = geometry;
 
-    monitor_t *monitor = NULL;
-    if (window->rule && window->rule->rules) {
+    /* Relayouts must not follow the cursor onto another monitor */
+    monitor_t *monitor = window->monitor;
+    if (!monitor && window->rule && window->rule->rules) {
         kv_value_t *value;
         value = get_value_from_key(window->rule->rules, "monitor");
 
@@ -228,28 +333,47 @@ void set_window_geometry(window_t *window, void *geometry) {
                 monitor = monitor_from_name(value->string);
     }
 
-    if (!monitor)
-        monitor = monitor_with_cursor_residence();
+    screen_geometry_t screen_geometry;
+    if (window->floating) {
+        screen_geometry = *(screen_geometry_t*)geometry;
 
-    screen_geometry_t *screen_geometry = NULL;
-    if (window->floating)
-        screen_geometry = (screen_geometry_t*)geometry;
-    else
-        screen_geometry = get_equivalent_screen_geometry(
+        if ((monitor = monitor_containing_geometry(&screen_geometry)))
+            window->monitor = monitor;
+    } else {
+        if (!monitor)
+            monitor = monitor_with_cursor_residence();
+        window->monitor = monitor;
+
+        screen_geometry_t *equivalent_geometry;
+        equivalent_geometry = get_equivalent_screen_geometry(
             (grid_geometry_t*)geometry, monitor);
-    apply_decoration_to_window_screen_geometry(window, screen_geometry);
+        screen_geometry = *equivalent_geometry;
+        free(equivalent_geometry);
+    }
+    apply_decoration_to_window_screen_geometry(window, &screen_geometry);
+
+    /* Kept so decorations never have to ask the server for it */
+    window->frame_geometry.x = (int)screen_geometry.x;
+    window->frame_geometry.y = (int)screen_geometry.y;
+    window->frame_geometry.height = (unsigned int)screen_geometry.height;
+    window->frame_geometry.width = (unsigned int)screen_geometry.width;
+
+    /* Strip borders paint their inner bands inside a larger frame */
+    unsigned int offset = get_client_offset(window);
 
     change_window_geometry(window->id,
-        0, 0,
-        (unsigned int)screen_geometry->height,
-        (unsigned int)screen_geometry->width);
+        offset, offset,
+        window->frame_geometry.height,
+        window->frame_geometry.width);
+
+    window->frame_geometry.height += offset * 2;
+    window->frame_geometry.width += offset * 2;
 
     change_window_geometry(window->parent,
-        (unsigned int)screen_geometry->x,
-        (unsigned int)screen_geometry->y,
-        (unsigned int)screen_geometry->height,
-        (unsigned int)screen_geometry->width);
-    free(screen_geometry);
+        window->frame_geometry.x,
+        window->frame_geometry.y,
+        window->frame_geometry.height,
+        window->frame_geometry.width);
 
     log_debug("Window(%08x) window geometry set", window->id);
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <time.h>
 #include <xcb/xcb.h>
 
 #include "config.h"
@@ -7,18 +8,28 @@
 #include "monitor.h"
 #include "rules.h"
 
+typedef struct border_pixmap border_pixmap_t;
+
 extern vector_t *windows;
 extern xcb_window_t focused_window;
 
 typedef struct {
     xcb_window_t id;
     xcb_window_t parent;
+    char *class;
+    char *instance;
     void *geometry;
+    pixel_geometry_t frame_geometry;
     rule_t *rule;
     monitor_t *monitor;
     unsigned short fullscreen;
     unsigned short floating;
     unsigned int workspace;
+    unsigned int protocols;
+    unsigned int border_size;
+    border_pixmap_t *borders[2];
+    xcb_window_t strips[4];
+    pixel_geometry_t strip_geometry;
 } window_t;
 
 unsigned short window_should_be_managed(xcb_window_t);
@@ -30,4 +41,9 @@ void unmanage_window(xcb_window_t);
 
 void set_window_geometry(window_t*, void*);
 
+void schedule_relayout(void);
+unsigned short relayout_is_pending(void);
+void continue_relayout(struct timespec*);
+void cancel_relayout(void);
+
 kv_value_t *get_setting_from_window_rules(window_t*, char*);
@@ -2,6 +2,8 @@
 #include <stdlib.h>
 
 #include "connection.h"
+#include "statistics.h"
+#include "window.h"
 
 #include "../wm/custard.h"
 
@@ -21,28 +23,26 @@ unsigned short initialize_xcb() {
 
     xcb_screen = xcb_setup_roots_iterator(xcb_get_setup(xcb_connection)).data;
 
+    /* Only the redirect is needed to claim the screen; the rest of the
+     * root event mask follows from the handlers in setup_event_masks */
     unsigned int events[1] = {
-        XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT |
-        XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY   |
-        XCB_EVENT_MASK_BUTTON_PRESS          |
-        XCB_EVENT_MASK_ENTER_WINDOW          |
-        XCB_EVENT_MASK_PROPERTY_CHANGE
+        XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT
     };
 
     xcb_void_cookie_t window_attributes_cookie;
-    window_attributes_cookie = xcb_change_window_attributes(xcb_connection,
-        xcb_screen->root, XCB_CW_EVENT_MASK, events);
+    window_attributes_cookie = xcb_change_window_attributes_checked(
+        xcb_connection, xcb_screen->root, XCB_CW_EVENT_MASK, events);
 
-    if (xcb_request_check(xcb_connection, window_attributes_cookie)) {
+    xcb_generic_error_t *error;
+    round_trip(error = xcb_request_check(xcb_connection,
+        window_attributes_cookie));
+
+    if (error) {
+        free(error);
         log_fatal("It appears another window manager is running.");
         return 0;
     }
 
-    events[0] ^= XCB_EVENT_MASK_ENTER_WINDOW;
-
-    xcb_change_window_attributes_checked(xcb_connection, xcb_screen->root,
-        XCB_CW_EVENT_MASK, events);
-
     xcb_depth_iterator_t depth_iterator = xcb_screen_allowed_depths_iterator(
         xcb_screen);
 
@@ -85,5 +85,6 @@ void finalize_xcb() {
 }
 
 void apply() {
+    flush_window_states();
     xcb_flush(xcb_connection);
 }
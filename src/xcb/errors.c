@@ -0,0 +1,34 @@
+#include "errors.h"
+
+/* Errors arrive asynchronously and only carry the low 16 bits of the
+ * sequence number of the request that caused them, so remember the most
+ * recent requests made on windows to explain them. */
+
+static tracked_request_t tracked_requests[TRACKED_REQUESTS];
+static unsigned int newest_request = 0;
+
+void track_request(unsigned int sequence, const char *request,
+    xcb_window_t window_id) {
+    newest_request = (newest_request + 1) % TRACKED_REQUESTS;
+
+    tracked_requests[newest_request].sequence = sequence;
+    tracked_requests[newest_request].request = request;
+    tracked_requests[newest_request].window = window_id;
+}
+
+tracked_request_t *find_tracked_request(unsigned short sequence) {
+    tracked_request_t *request;
+
+    for (unsigned int age = 0; age < TRACKED_REQUESTS; age++) {
+        request = &tracked_requests[
+            (newest_request + TRACKED_REQUESTS - age) % TRACKED_REQUESTS];
+
+        if (!request->request)
+            break;
+
+        if ((unsigned short)request->sequence == sequence)
+            return request;
+    }
+
+    return NULL;
+}
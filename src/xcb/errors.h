@@ -0,0 +1,14 @@
+#pragma once
+
+#include <xcb/xcb.h>
+
+#define TRACKED_REQUESTS 256
+
+typedef struct {
+    unsigned int sequence;
+    const char *request;
+    xcb_window_t window;
+} tracked_request_t;
+
+void track_request(unsigned int, const char*, xcb_window_t);
+tracked_request_t *find_tracked_request(unsigned short);
@@ -1,41 +1,77 @@
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <xcb/xcb.h>
 
 #include "connection.h"
 #include "ewmh.h"
+#include "statistics.h"
 
 #include "../wm/custard.h"
 
 xcb_ewmh_connection_t *ewmh_connection;
 xcb_window_t ewmh_window;
+xcb_atom_t atoms[ATOM_COUNT];
+
+static const char *atom_names[ATOM_COUNT] = {
+    [WM_DELETE_WINDOW] = "WM_DELETE_WINDOW",
+    [WM_STATE]         = "WM_STATE",
+    [WM_TAKE_FOCUS]    = "WM_TAKE_FOCUS",
+    [WM_CHANGE_STATE]  = "WM_CHANGE_STATE"
+};
 
 unsigned short initialize_ewmh() {
     ewmh_window = xcb_generate_id(xcb_connection);
 
-    unsigned int events[1] = {
-        XCB_EVENT_MASK_POINTER_MOTION
-    };
-
+    /* Only ever read by clients; it selects no events */
     xcb_create_window(xcb_connection, XCB_COPY_FROM_PARENT, ewmh_window,
         xcb_screen->root, 0, 0,
         xcb_screen->width_in_pixels, xcb_screen->height_in_pixels, 0,
         XCB_WINDOW_CLASS_INPUT_OUTPUT, XCB_COPY_FROM_PARENT,
-        XCB_CW_EVENT_MASK, events);
+        0, NULL);
 
     ewmh_connection = (xcb_ewmh_connection_t*)calloc(1,
         sizeof(xcb_ewmh_connection_t));
 
+    /* Every intern request goes out before any reply is waited on */
+
+    unsigned int index;
+    xcb_intern_atom_cookie_t atom_cookies[ATOM_COUNT];
+    for (index = 0; index < ATOM_COUNT; index++)
+        atom_cookies[index] = xcb_intern_atom(xcb_connection, 0,
+            strlen(atom_names[index]), atom_names[index]);
+
     xcb_intern_atom_cookie_t *initialize_atoms_cookie;
     initialize_atoms_cookie = xcb_ewmh_init_atoms(xcb_connection,
         ewmh_connection);
 
-    if (!xcb_ewmh_init_atoms_replies(ewmh_connection, initialize_atoms_cookie,
-        NULL)) {
+    unsigned char atoms_initialized;
+    round_trip(atoms_initialized = xcb_ewmh_init_atoms_replies(
+        ewmh_connection, initialize_atoms_cookie, NULL));
+
+    if (!atoms_initialized) {
         log_fatal("Unable to initialize atoms");
+        for (index = 0; index < ATOM_COUNT; index++)
+            xcb_discard_reply(xcb_connection, atom_cookies[index].sequence);
         free(ewmh_connection);
+        ewmh_connection = NULL;
         return 0;
     }
 
+    xcb_intern_atom_reply_t *atom_reply;
+    for (index = 0; index < ATOM_COUNT; index++) {
+        round_trip(atom_reply = xcb_intern_atom_reply(xcb_connection,
+            atom_cookies[index], NULL));
+
+        if (!atom_reply) {
+            log_fatal("Unable to intern atom %s", atom_names[index]);
+            return 0;
+        }
+
+        atoms[index] = atom_reply->atom;
+        free(atom_reply);
+    }
+
     xcb_ewmh_set_wm_pid(ewmh_connection, ewmh_window, getpid());
     xcb_ewmh_set_wm_name(ewmh_connection, ewmh_window, 7, "custard");
     xcb_ewmh_set_supporting_wm_check(ewmh_connection, xcb_screen->root,
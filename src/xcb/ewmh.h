@@ -2,8 +2,23 @@
 
 #include <xcb/xcb_ewmh.h>
 
+/*
+ * ICCCM atoms interned at startup alongside the EWMH atoms. _NET_ atoms
+ * (_NET_WM_SYNC_REQUEST, _NET_WM_STATE_HIDDEN, ...) are already held by
+ * ewmh_connection.
+ */
+
+typedef enum {
+    WM_DELETE_WINDOW = 0,
+    WM_STATE,
+    WM_TAKE_FOCUS,
+    WM_CHANGE_STATE,
+    ATOM_COUNT
+} atom_index_t;
+
 extern xcb_ewmh_connection_t *ewmh_connection;
 extern xcb_window_t ewmh_window;
+extern xcb_atom_t atoms[ATOM_COUNT];
 
 unsigned short initialize_ewmh(void);
 void finalize_ewmh(void);
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <xcb/xcb.h>
+
+#include "connection.h"
+#include "statistics.h"
+
+#include "../wm/custard.h"
+
+vector_t *request_statistics = NULL;
+
+/* Off by default, counting costs two requests per context */
+unsigned short count_requests = 0;
+
+static request_statistics_t *current_context = NULL;
+static unsigned int context_sequence = 0;
+static unsigned int context_round_trips = 0;
+static unsigned long context_blocked = 0;
+static struct timespec round_trip_start;
+
+request_statistics_t *find_request_context(const char *name) {
+    /* Valid until finalize_request_statistics, callers may keep it */
+    if (!request_statistics)
+        request_statistics = construct_vector();
+
+    request_statistics_t *statistics;
+    for (unsigned int index = 0; index < request_statistics->size; index++) {
+        statistics = get_from_vector(request_statistics, index);
+        if (!strcmp(statistics->name, name))
+            return statistics;
+    }
+
+    statistics = (request_statistics_t*)calloc(1,
+        sizeof(request_statistics_t));
+    statistics->name = (char*)calloc(strlen(name) + 1, sizeof(char));
+    strcpy(statistics->name, name);
+
+    push_to_vector(request_statistics, statistics);
+
+    return statistics;
+}
+
+static unsigned int sample_sequence() {
+    /* A NoOperation is the cheapest way of learning how many requests
+     * have gone out; it has no reply and the server ignores it. */
+    return xcb_no_operation(xcb_connection).sequence;
+}
+
+void begin_request_context(const char *name) {
+    enter_request_context(find_request_context(name));
+}
+
+void enter_request_context(request_statistics_t *context) {
+    current_context = context;
+    current_context->calls++;
+
+    context_round_trips = 0;
+    context_blocked = 0;
+    if (count_requests)
+        context_sequence = sample_sequence();
+}
+
+const char *request_context_name() {
+    /* Lives until finalize_request_statistics */
+    return current_context ? current_context->name : NULL;
+}
+
+void end_request_context() {
+    if (!current_context)
+        return;
+
+    unsigned int requests = 0;
+    if (count_requests) {
+        requests = sample_sequence() - context_sequence - 1;
+        current_context->requests += requests;
+    }
+
+    if (context_round_trips)
+        log_debug("%s: %d requests, %d round trips, %lu.%03lums blocked",
+            current_context->name, requests, context_round_trips,
+            context_blocked / 1000, context_blocked % 1000);
+
+    current_context = NULL;
+}
+
+void begin_round_trip() {
+    clock_gettime(CLOCK_MONOTONIC, &round_trip_start);
+}
+
+void end_round_trip() {
+    struct timespec round_trip_end;
+    clock_gettime(CLOCK_MONOTONIC, &round_trip_end);
+
+    unsigned long blocked = (unsigned long)
+        ((round_trip_end.tv_sec - round_trip_start.tv_sec) * 1000000 +
+        (round_trip_end.tv_nsec - round_trip_start.tv_nsec) / 1000);
+
+    /* Round trips outside of any handler, such as during startup */
+    request_statistics_t *statistics = current_context;
+    if (!statistics)
+        statistics = find_request_context("other");
+
+    statistics->round_trips++;
+    statistics->blocked += blocked;
+
+    context_round_trips++;
+    context_blocked += blocked;
+}
+
+char *format_request_statistics() {
+    const char *header = "context calls requests round_trips blocked_us\n";
+    unsigned int size = strlen(header) + 1;
+    unsigned int count = request_statistics ? request_statistics->size : 0;
+
+    request_statistics_t *statistics;
+    for (unsigned int index = 0; index < count; index++) {
+        statistics = get_from_vector(request_statistics, index);
+        size += strlen(statistics->name) + 3 * 11 + 21;
+    }
+
+    char *output = (char*)calloc(size, sizeof(char));
+    unsigned int length = sprintf(output, "%s", header);
+
+    /* Requests are left out unless they were counted */
+    for (unsigned int index = 0; index < count; index++) {
+        statistics = get_from_vector(request_statistics, index);
+        length += sprintf(output + length, "%s %u ", statistics->name,
+            statistics->calls);
+        if (count_requests)
+            length += sprintf(output + length, "%u", statistics->requests);
+        else
+            length += sprintf(output + length, "-");
+        length += sprintf(output + length, " %u %lu\n",
+            statistics->round_trips, statistics->blocked);
+    }
+
+    return output;
+}
+
+void log_request_statistics() {
+    if (!request_statistics)
+        return;
+
+    request_statistics_t *statistics;
+    for (unsigned int index = 0; index < request_statistics->size; index++) {
+        statistics = get_from_vector(request_statistics, index);
+        log_debug("%s: %d calls, %d requests, %d round trips, %lums blocked",
+            statistics->name, statistics->calls, statistics->requests,
+            statistics->round_trips, statistics->blocked / 1000);
+    }
+}
+
+void finalize_request_statistics() {
+    if (!request_statistics)
+        return;
+
+    log_request_statistics();
+
+    request_statistics_t *statistics;
+    while ((statistics = vector_iterator(request_statistics))) {
+        free(statistics->name);
+        free(statistics);
+    }
+
+    deconstruct_vector(request_statistics);
+    request_statistics = NULL;
+}
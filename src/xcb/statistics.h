@@ -0,0 +1,32 @@
+#pragma once
+
+#include "../vector.h"
+
+typedef struct {
+    char *name;
+    unsigned int calls;
+    unsigned int requests;
+    unsigned int round_trips;
+    unsigned long blocked; /* microseconds */
+} request_statistics_t;
+
+extern vector_t *request_statistics;
+extern unsigned short count_requests;
+
+request_statistics_t *find_request_context(const char*);
+void begin_request_context(const char*);
+void enter_request_context(request_statistics_t*);
+void end_request_context(void);
+const char *request_context_name(void);
+
+void begin_round_trip(void);
+void end_round_trip(void);
+
+/* Every blocking reply goes through here, e.g.
+ *  round_trip(reply = xcb_query_tree_reply(xcb_connection, cookie, NULL)); */
+#define round_trip(...) \
+    do { begin_round_trip(); __VA_ARGS__; end_round_trip(); } while (0)
+
+char *format_request_statistics(void);
+void log_request_statistics(void);
+void finalize_request_statistics(void);
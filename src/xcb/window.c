@@ -1,45 +1,457 @@
+#include <stdlib.h>
+#include <string.h>
 #include <xcb/xcb_icccm.h>
 
 #include "connection.h"
+#include "errors.h"
 #include "ewmh.h"
+#include "statistics.h"
 #include "window.h"
 
+#include "../table.h"
+#include "../vector.h"
+
 #include "../wm/custard.h"
 
+/*
+ * Requests that change a window's geometry, stacking, map state or
+ * decoration are recorded here and only sent when apply() flushes them,
+ * once per window, with the final state of the event loop iteration.
+ */
+
+table_t *window_states = NULL;
+vector_t *dirty_windows = NULL;
+static vector_t *spare_window_states = NULL;
+xcb_window_t pending_focus = XCB_WINDOW_NONE;
+static unsigned short replay_is_pending = 0;
+static xcb_timestamp_t pending_replay;
+
+unsigned int window_requests_recorded = 0;
+unsigned int window_requests_sent = 0;
+unsigned int window_requests_dropped = 0;
+
+static xcb_window_t topmost_window = XCB_WINDOW_NONE;
+static xcb_window_t bottommost_window = XCB_WINDOW_NONE;
+
+static void construct_window_states() {
+    window_states = construct_table();
+    dirty_windows = construct_vector();
+    spare_window_states = construct_vector();
+}
+
+void reserve_window_states(unsigned int count) {
+    if (!window_states)
+        construct_window_states();
+
+    reserve_table(window_states, count);
+    reserve_vector(dirty_windows, count);
+    reserve_vector(spare_window_states, count);
+
+    while (spare_window_states->size < count)
+        push_to_vector(spare_window_states,
+            calloc(1, sizeof(window_state_t)));
+}
+
+window_state_t *get_window_state(xcb_window_t window_id) {
+    if (!window_states)
+        construct_window_states();
+
+    window_state_t *state = get_from_table(window_states, window_id);
+
+    if (!state) {
+        /* Forgotten states are reused before anything is allocated */
+        if (spare_window_states->size) {
+            state = get_from_vector(spare_window_states,
+                spare_window_states->size - 1);
+            truncate_vector(spare_window_states,
+                spare_window_states->size - 1);
+            memset(state, 0, sizeof(window_state_t));
+        } else
+            state = (window_state_t*)calloc(1, sizeof(window_state_t));
+
+        state->id = window_id;
+        insert_into_table(window_states, window_id, state);
+    }
+
+    return state;
+}
+
+static void mark_window_dirty(window_state_t *state) {
+    window_requests_recorded++;
+
+    if (state->dirty)
+        return;
+
+    state->dirty = 1;
+    push_to_vector(dirty_windows, state);
+}
+
+static void pull_from_dirty_windows(window_state_t *state) {
+    for (unsigned int index = 0; index < dirty_windows->size; index++) {
+        if (get_from_vector(dirty_windows, index) == state) {
+            pull_from_vector(dirty_windows, index);
+            return;
+        }
+    }
+}
+
 void configure_window(xcb_window_t window_id, unsigned int value_mask,
     unsigned int *values) {
-    xcb_configure_window(xcb_connection, window_id, value_mask, values);
+    window_state_t *state = get_window_state(window_id);
+
+    unsigned int value = 0;
+    for (unsigned int bit = 0; bit < CONFIGURATION_VALUES; bit++)
+        if (value_mask & (1 << bit))
+            state->configuration[bit] = values[value++];
+
+    state->configuration_mask |= value_mask;
+
+    /* Restacked windows flush last, in the order they were restacked */
+    if (state->dirty && (value_mask & XCB_CONFIG_WINDOW_STACK_MODE)) {
+        pull_from_dirty_windows(state);
+        push_to_vector(dirty_windows, state);
+    }
+
+    mark_window_dirty(state);
 
     log_debug("Window(%08x) configured", window_id);
 }
 
+void change_window_attributes(xcb_window_t window_id, unsigned int value_mask,
+    unsigned int *values) {
+    window_state_t *state = get_window_state(window_id);
+
+    /* A pixel and a pixmap for the same thing; the latest one wins */
+    if (value_mask & XCB_CW_BACK_PIXEL)
+        state->attribute_mask &= ~XCB_CW_BACK_PIXMAP;
+    if (value_mask & XCB_CW_BACK_PIXMAP)
+        state->attribute_mask &= ~XCB_CW_BACK_PIXEL;
+    if (value_mask & XCB_CW_BORDER_PIXEL)
+        state->attribute_mask &= ~XCB_CW_BORDER_PIXMAP;
+    if (value_mask & XCB_CW_BORDER_PIXMAP)
+        state->attribute_mask &= ~XCB_CW_BORDER_PIXEL;
+
+    unsigned int value = 0;
+    for (unsigned int bit = 0; bit < ATTRIBUTE_VALUES; bit++)
+        if (value_mask & (1 << bit))
+            state->attributes[bit] = values[value++];
+
+    state->attribute_mask |= value_mask;
+    mark_window_dirty(state);
+}
+
+void clear_window(xcb_window_t window_id) {
+    window_state_t *state = get_window_state(window_id);
+
+    state->clear = 1;
+    mark_window_dirty(state);
+}
+
 void map_window(xcb_window_t window_id) {
-    xcb_map_window(xcb_connection, window_id);
+    window_state_t *state = get_window_state(window_id);
+
+    state->map_request = WINDOW_MAP;
+    mark_window_dirty(state);
 
     log_debug("Window(%08x) mapped", window_id);
 }
 
 void unmap_window(xcb_window_t window_id) {
-    xcb_unmap_window(xcb_connection, window_id);
+    window_state_t *state = get_window_state(window_id);
+
+    state->map_request = WINDOW_UNMAP;
+    mark_window_dirty(state);
 
     log_debug("Window(%08x) unmapped", window_id);
 }
 
 void focus_window(xcb_window_t window_id) {
-    unsigned int values[2] = {
-        XCB_ICCCM_WM_STATE_NORMAL,
-        XCB_NONE
-    };
+    /* Sent after the windows are flushed; it may not be viewable yet */
+    pending_focus = window_id;
+
+    log_debug("Window(%08x) focused", window_id);
+}
+
+void replay_pointer(xcb_timestamp_t time) {
+    /* Sent after focus, so the client sees the click as focused */
+    replay_is_pending = 1;
+    pending_replay = time;
+}
 
-    xcb_change_property(xcb_connection, XCB_PROP_MODE_REPLACE, window_id,
-        ewmh_connection->_NET_WM_STATE, ewmh_connection->_NET_WM_STATE,
-        32, 2, values);
+void forget_window(xcb_window_t window_id) {
+    if (!window_states)
+        return;
 
-    xcb_set_input_focus(xcb_connection, XCB_INPUT_FOCUS_POINTER_ROOT,
-        window_id, XCB_CURRENT_TIME);
-    xcb_ewmh_set_active_window(ewmh_connection, 0, window_id);
+    window_state_t *state = pull_from_table(window_states, window_id);
 
-    log_debug("Window(%08x) focused", window_id);
+    if (pending_focus == window_id)
+        pending_focus = XCB_WINDOW_NONE;
+
+    if (!state)
+        return;
+
+    if (state->dirty)
+        pull_from_dirty_windows(state);
+
+    push_to_vector(spare_window_states, state);
+}
+
+void forget_stacking() {
+    /* A new sibling appeared; previous restacks say nothing anymore */
+    topmost_window = bottommost_window = XCB_WINDOW_NONE;
+}
+
+static unsigned short is_stale(window_state_t *state,
+    unsigned short sequence) {
+    /* Events generated before our last request to this window */
+    return (short)(sequence - (unsigned short)state->sequence) < 0;
+}
+
+void note_window_geometry(xcb_window_t window_id, unsigned int x,
+    unsigned int y, unsigned int width, unsigned int height,
+    unsigned int border_width, unsigned short sequence) {
+    if (!window_states)
+        return;
+
+    window_state_t *state = get_from_table(window_states, window_id);
+    if (!state || is_stale(state, sequence))
+        return;
+
+    unsigned int values[5] = { x, y, width, height, border_width };
+    for (unsigned int bit = 0; bit < 5; bit++)
+        state->known_configuration[bit] = values[bit];
+
+    state->known_configuration_mask |= XCB_CONFIG_WINDOW_X |
+        XCB_CONFIG_WINDOW_Y | XCB_CONFIG_WINDOW_WIDTH |
+        XCB_CONFIG_WINDOW_HEIGHT | XCB_CONFIG_WINDOW_BORDER_WIDTH;
+}
+
+void note_window_map_state(xcb_window_t window_id, map_request_t map_state,
+    unsigned short sequence) {
+    if (!window_states)
+        return;
+
+    window_state_t *state = get_from_table(window_states, window_id);
+    if (!state || is_stale(state, sequence))
+        return;
+
+    state->known_map_state = map_state;
+}
+
+static unsigned int trim_configuration(window_state_t *state) {
+    unsigned int value_mask = state->configuration_mask;
+
+    for (unsigned int bit = 0; bit < CONFIGURATION_VALUES - 2; bit++)
+        if ((value_mask & state->known_configuration_mask & (1 << bit)) &&
+            state->configuration[bit] == state->known_configuration[bit])
+            value_mask &= ~(1 << bit);
+
+    if ((value_mask & XCB_CONFIG_WINDOW_STACK_MODE) &&
+        !(value_mask & XCB_CONFIG_WINDOW_SIBLING)) {
+        unsigned int stack_mode = state->configuration[6];
+
+        if ((stack_mode == XCB_STACK_MODE_ABOVE &&
+            topmost_window == state->id) ||
+            (stack_mode == XCB_STACK_MODE_BELOW &&
+            bottommost_window == state->id))
+            value_mask &= ~XCB_CONFIG_WINDOW_STACK_MODE;
+    }
+
+    return value_mask;
+}
+
+static unsigned int trim_attributes(window_state_t *state) {
+    unsigned int value_mask = state->attribute_mask;
+
+    for (unsigned int bit = 0; bit < ATTRIBUTE_VALUES; bit++)
+        if ((value_mask & state->known_attribute_mask & (1 << bit)) &&
+            state->attributes[bit] == state->known_attributes[bit])
+            value_mask &= ~(1 << bit);
+
+    return value_mask;
+}
+
+void flush_window_states() {
+    if (!dirty_windows)
+        return;
+
+    window_state_t *state;
+    xcb_void_cookie_t cookie;
+    unsigned int values[ATTRIBUTE_VALUES];
+    unsigned int value_mask, bit, value;
+    unsigned int recorded = window_requests_recorded;
+    unsigned int sent = window_requests_sent;
+    unsigned int dropped = window_requests_dropped;
+
+    for (unsigned int index = 0; index < dirty_windows->size; index++) {
+        state = get_from_vector(dirty_windows, index);
+
+        if (state->map_request == WINDOW_UNMAP) {
+            if (state->known_map_state == WINDOW_UNMAP) {
+                window_requests_dropped++;
+            } else {
+                cookie = xcb_unmap_window(xcb_connection, state->id);
+                track_request(cookie.sequence, "UnmapWindow", state->id);
+                state->sequence = cookie.sequence;
+                state->known_map_state = WINDOW_UNMAP;
+                window_requests_sent++;
+            }
+        }
+
+        if (state->configuration_mask) {
+            value_mask = trim_configuration(state);
+
+            for (bit = 0, value = 0; bit < CONFIGURATION_VALUES; bit++) {
+                if (value_mask & (1 << bit)) {
+                    values[value++] = state->configuration[bit];
+                    state->known_configuration[bit] =
+                        state->configuration[bit];
+                }
+            }
+
+            if (value_mask) {
+                cookie = xcb_configure_window(xcb_connection, state->id,
+                    value_mask, values);
+                track_request(cookie.sequence, "ConfigureWindow", state->id);
+                state->sequence = cookie.sequence;
+                state->known_configuration_mask |= value_mask &
+                    ~XCB_CONFIG_WINDOW_STACK_MODE;
+                window_requests_sent++;
+
+                if (value_mask & XCB_CONFIG_WINDOW_SIBLING) {
+                    forget_stacking();
+                } else if (value_mask & XCB_CONFIG_WINDOW_STACK_MODE) {
+                    if (state->configuration[6] == XCB_STACK_MODE_ABOVE) {
+                        topmost_window = state->id;
+                        if (bottommost_window == state->id)
+                            bottommost_window = XCB_WINDOW_NONE;
+                    } else {
+                        topmost_window = XCB_WINDOW_NONE;
+                        bottommost_window =
+                            (state->configuration[6] == XCB_STACK_MODE_BELOW) ?
+                            state->id : XCB_WINDOW_NONE;
+                    }
+                }
+            } else window_requests_dropped++;
+        }
+
+        if (state->attribute_mask) {
+            value_mask = trim_attributes(state);
+
+            for (bit = 0, value = 0; bit < ATTRIBUTE_VALUES; bit++) {
+                if (value_mask & (1 << bit)) {
+                    values[value++] = state->attributes[bit];
+                    state->known_attributes[bit] = state->attributes[bit];
+                }
+            }
+
+            if (value_mask) {
+                cookie = xcb_change_window_attributes(xcb_connection,
+                    state->id, value_mask, values);
+                track_request(cookie.sequence, "ChangeWindowAttributes",
+                    state->id);
+                state->sequence = cookie.sequence;
+                state->known_attribute_mask |= value_mask;
+                window_requests_sent++;
+
+                /* The pixel or pixmap that was not sent is now unknown */
+                if (value_mask & XCB_CW_BACK_PIXEL)
+                    state->known_attribute_mask &= ~XCB_CW_BACK_PIXMAP;
+                if (value_mask & XCB_CW_BACK_PIXMAP)
+                    state->known_attribute_mask &= ~XCB_CW_BACK_PIXEL;
+                if (value_mask & XCB_CW_BORDER_PIXEL)
+                    state->known_attribute_mask &= ~XCB_CW_BORDER_PIXMAP;
+                if (value_mask & XCB_CW_BORDER_PIXMAP)
+                    state->known_attribute_mask &= ~XCB_CW_BORDER_PIXEL;
+            } else {
+                window_requests_dropped++;
+
+                /* Nothing changed, so there is nothing to repaint */
+                if (state->clear) {
+                    state->clear = 0;
+                    window_requests_dropped++;
+                }
+            }
+        }
+
+        if (state->map_request == WINDOW_MAP) {
+            if (state->known_map_state == WINDOW_MAP) {
+                window_requests_dropped++;
+            } else {
+                cookie = xcb_map_window(xcb_connection, state->id);
+                track_request(cookie.sequence, "MapWindow", state->id);
+                state->sequence = cookie.sequence;
+                state->known_map_state = WINDOW_MAP;
+                window_requests_sent++;
+            }
+        }
+
+        if (state->clear) {
+            cookie = xcb_clear_area(xcb_connection, 0, state->id,
+                0, 0, 0, 0);
+            track_request(cookie.sequence, "ClearArea", state->id);
+            window_requests_sent++;
+        }
+
+        state->configuration_mask = 0;
+        state->attribute_mask = 0;
+        state->map_request = 0;
+        state->clear = 0;
+        state->dirty = 0;
+    }
+
+    if (dirty_windows->size)
+        log_debug("Flushed %d windows, %d requests sent and %d dropped "
+            "for %d recorded", dirty_windows->size,
+            window_requests_sent - sent, window_requests_dropped - dropped,
+            window_requests_recorded - recorded);
+
+    clear_vector(dirty_windows);
+
+    if (pending_focus != XCB_WINDOW_NONE) {
+        unsigned int properties[2] = {
+            XCB_ICCCM_WM_STATE_NORMAL,
+            XCB_NONE
+        };
+
+        cookie = xcb_change_property(xcb_connection, XCB_PROP_MODE_REPLACE,
+            pending_focus, atoms[WM_STATE], atoms[WM_STATE], 32, 2,
+            properties);
+        track_request(cookie.sequence, "ChangeProperty", pending_focus);
+
+        cookie = xcb_set_input_focus(xcb_connection,
+            XCB_INPUT_FOCUS_POINTER_ROOT, pending_focus, XCB_CURRENT_TIME);
+        track_request(cookie.sequence, "SetInputFocus", pending_focus);
+        xcb_ewmh_set_active_window(ewmh_connection, 0, pending_focus);
+
+        pending_focus = XCB_WINDOW_NONE;
+    }
+
+    if (replay_is_pending) {
+        xcb_allow_events(xcb_connection, XCB_ALLOW_REPLAY_POINTER,
+            pending_replay);
+        replay_is_pending = 0;
+    }
+}
+
+void finalize_window_states() {
+    if (!window_states)
+        return;
+
+    for (unsigned int index = 0; index < window_states->memory; index++)
+        free(window_states->entries[index].value);
+
+    window_state_t *state;
+    while ((state = vector_iterator(spare_window_states)))
+        free(state);
+
+    deconstruct_table(window_states);
+    deconstruct_vector(dirty_windows);
+    deconstruct_vector(spare_window_states);
+
+    window_states = NULL;
+    dirty_windows = NULL;
+    spare_window_states = NULL;
 }
 
 void raise_window(xcb_window_t window_id) {
@@ -64,60 +476,90 @@ void lower_window(xcb_window_t window_id) {
     log_debug("Window(%08x) lowered", window_id);
 }
 
-void close_window(xcb_window_t window_id) {
-    xcb_get_property_cookie_t protocols_cookie;
-    protocols_cookie = xcb_icccm_get_wm_protocols(xcb_connection, window_id,
+xcb_get_property_cookie_t request_protocols_of_window(
+    xcb_window_t window_id) {
+    return xcb_icccm_get_wm_protocols(xcb_connection, window_id,
         ewmh_connection->WM_PROTOCOLS);
+}
 
-    xcb_intern_atom_cookie_t delete_cookie;
-    delete_cookie = xcb_intern_atom(xcb_connection, 0, 16, "WM_DELETE_WINDOW");
-
+unsigned int protocols_from_reply(xcb_get_property_cookie_t cookie) {
+    /* Blocks; the caller wraps it in round_trip() */
     xcb_icccm_get_wm_protocols_reply_t protocols;
-    xcb_icccm_get_wm_protocols_reply(xcb_connection, protocols_cookie,
-        &protocols, NULL);
-
-    xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(xcb_connection,
-        delete_cookie, NULL);
-
-    if (reply) {
-        for (unsigned int index = 0; index < protocols.atoms_len; index++) {
-            if (protocols.atoms[index] == reply->atom) {
-
-                xcb_client_message_event_t event = {
-                    .response_type = XCB_CLIENT_MESSAGE,
-                    .format        = 32,
-                    .sequence      = 0,
-                    .window        = window_id,
-                    .type          = ewmh_connection->WM_PROTOCOLS,
-                    .data.data32   = {
-                        reply->atom, XCB_CURRENT_TIME
-                    }
-                };
 
-                xcb_send_event(xcb_connection, 0, window_id,
-                    XCB_EVENT_MASK_NO_EVENT, (char*)&event);
-                xcb_icccm_get_wm_protocols_reply_wipe(&protocols);
+    if (!xcb_icccm_get_wm_protocols_reply(xcb_connection, cookie,
+        &protocols, NULL))
+        return 0;
+
+    unsigned int supported = 0;
+    for (unsigned int index = 0; index < protocols.atoms_len; index++) {
+        if (protocols.atoms[index] == atoms[WM_DELETE_WINDOW])
+            supported |= PROTOCOL_DELETE_WINDOW;
+        else if (protocols.atoms[index] == atoms[WM_TAKE_FOCUS])
+            supported |= PROTOCOL_TAKE_FOCUS;
+        else if (protocols.atoms[index] ==
+            ewmh_connection->_NET_WM_SYNC_REQUEST)
+            supported |= PROTOCOL_SYNC_REQUEST;
+    }
+
+    xcb_icccm_get_wm_protocols_reply_wipe(&protocols);
+
+    return supported;
+}
+
+unsigned int protocols_of_window(xcb_window_t window_id) {
+    unsigned int supported;
+    round_trip(supported = protocols_from_reply(
+        request_protocols_of_window(window_id)));
+
+    return supported;
+}
 
-                log_debug("Window(%08x) closed(WM_PROTOCOLS)", window_id);
-                return;
+void close_window(xcb_window_t window_id, unsigned int protocols) {
+    /*
+     * protocols is what was read at map time. ICCCM has clients set it
+     * before mapping, but before resorting to a kill it is read again in
+     * case WM_DELETE_WINDOW was added later.
+     */
+    if (!(protocols & PROTOCOL_DELETE_WINDOW))
+        protocols = protocols_of_window(window_id);
+
+    if (protocols & PROTOCOL_DELETE_WINDOW) {
+        xcb_client_message_event_t event = {
+            .response_type = XCB_CLIENT_MESSAGE,
+            .format        = 32,
+            .sequence      = 0,
+            .window        = window_id,
+            .type          = ewmh_connection->WM_PROTOCOLS,
+            .data.data32   = {
+                atoms[WM_DELETE_WINDOW], XCB_CURRENT_TIME
             }
-        }
+        };
+
+        xcb_void_cookie_t cookie = xcb_send_event(xcb_connection, 0,
+            window_id, XCB_EVENT_MASK_NO_EVENT, (char*)&event);
+        track_request(cookie.sequence, "SendEvent", window_id);
+
+        log_debug("Window(%08x) closed(WM_PROTOCOLS)", window_id);
+        return;
     }
 
-    xcb_icccm_get_wm_protocols_reply_wipe(&protocols);
-    xcb_kill_client(xcb_connection, window_id);
+    xcb_void_cookie_t cookie = xcb_kill_client(xcb_connection, window_id);
+    track_request(cookie.sequence, "KillClient", window_id);
 
     log_debug("Window(%08x) closed(xcb_kill_client)", window_id);
 }
 
-void change_window_geometry(xcb_window_t window_id, unsigned int x,
-    unsigned int y, unsigned int height, unsigned int width) {
+void change_window_geometry(xcb_window_t window_id, int x, int y,
+    unsigned int height, unsigned int width) {
 
     unsigned int value_mask = XCB_CONFIG_WINDOW_X |
         XCB_CONFIG_WINDOW_Y     |
         XCB_CONFIG_WINDOW_WIDTH |
         XCB_CONFIG_WINDOW_HEIGHT;
-    unsigned int values[4] = { x, y, width, height };
+    /* X and Y are sign-extended INT16s on the wire */
+    unsigned int values[4] = {
+        (unsigned int)x, (unsigned int)y, width, height
+    };
 
     configure_window(window_id, value_mask, values);
 
@@ -132,7 +574,8 @@ void *get_window_property(xcb_window_t window_id, xcb_atom_t property,
         atom_type, 0, 256);
 
     xcb_get_property_reply_t *property_cookie;
-    property_cookie = xcb_get_property_reply(xcb_connection, atom_cookie, NULL);
+    round_trip(property_cookie = xcb_get_property_reply(xcb_connection,
+        atom_cookie, NULL));
 
     void *window_property;
     window_property = xcb_get_property_value(property_cookie);
@@ -147,9 +590,42 @@ char *name_of_window(xcb_window_t window_id) {
     return name;
 }
 
-char *class_of_window(xcb_window_t window_id) {
-    char *class = (char*)get_window_property(window_id, XCB_ATOM_WM_CLASS,
-        XCB_GET_PROPERTY_TYPE_ANY);
+xcb_get_property_cookie_t request_class_of_window(xcb_window_t window_id) {
+    return xcb_get_property(xcb_connection, 0, window_id, XCB_ATOM_WM_CLASS,
+        XCB_ATOM_STRING, 0, 256);
+}
+
+char *class_from_reply(xcb_get_property_cookie_t cookie, char **instance) {
+    /*
+     * WM_CLASS is the instance and then the class, each NUL-terminated.
+     * Both come back as copies. Blocks; the caller wraps it in
+     * round_trip().
+     */
+    *instance = NULL;
+
+    xcb_get_property_reply_t *reply;
+    reply = xcb_get_property_reply(xcb_connection, cookie, NULL);
+
+    if (!reply)
+        return NULL;
+
+    char *value = (char*)xcb_get_property_value(reply);
+    unsigned int length = xcb_get_property_value_length(reply);
+    unsigned int instance_length = strnlen(value, length);
+
+    *instance = (char*)calloc(instance_length + 1, sizeof(char));
+    memcpy(*instance, value, instance_length);
+
+    /* Fall back on the instance when the class is missing */
+    if (instance_length + 1 < length) {
+        value += instance_length + 1;
+        length = strnlen(value, length - instance_length - 1);
+    } else
+        length = instance_length;
+
+    char *class = (char*)calloc(length + 1, sizeof(char));
+    memcpy(class, value, length);
+    free(reply);
 
     return class;
 }
@@ -2,21 +2,72 @@
 
 #include <xcb/xcb.h>
 
+#define PROTOCOL_DELETE_WINDOW (1 << 0)
+#define PROTOCOL_TAKE_FOCUS    (1 << 1)
+#define PROTOCOL_SYNC_REQUEST  (1 << 2)
+
+#define CONFIGURATION_VALUES 7  /* XCB_CONFIG_WINDOW_X ... STACK_MODE */
+#define ATTRIBUTE_VALUES     15 /* XCB_CW_BACK_PIXMAP ... XCB_CW_CURSOR */
+
+typedef enum {
+    WINDOW_MAP = 1,
+    WINDOW_UNMAP = 2
+} map_request_t;
+
+typedef struct {
+    xcb_window_t id;
+    unsigned short dirty;
+    unsigned int configuration_mask;
+    unsigned int configuration[CONFIGURATION_VALUES];
+    unsigned int attribute_mask;
+    unsigned int attributes[ATTRIBUTE_VALUES];
+    map_request_t map_request;
+    unsigned short clear;
+
+    /* What the server was last told, or last reported */
+    unsigned int sequence;
+    unsigned int known_configuration_mask;
+    unsigned int known_configuration[CONFIGURATION_VALUES];
+    unsigned int known_attribute_mask;
+    unsigned int known_attributes[ATTRIBUTE_VALUES];
+    map_request_t known_map_state;
+} window_state_t;
+
+extern unsigned int window_requests_recorded;
+extern unsigned int window_requests_sent;
+extern unsigned int window_requests_dropped;
+
+void reserve_window_states(unsigned int);
+window_state_t *get_window_state(xcb_window_t);
 void configure_window(xcb_window_t, unsigned int, unsigned int*);
+void change_window_attributes(xcb_window_t, unsigned int, unsigned int*);
+void clear_window(xcb_window_t);
 
 void map_window(xcb_window_t);
 void unmap_window(xcb_window_t);
 
 void focus_window(xcb_window_t);
+void replay_pointer(xcb_timestamp_t);
+void forget_window(xcb_window_t);
+void forget_stacking(void);
+void note_window_geometry(xcb_window_t, unsigned int, unsigned int,
+    unsigned int, unsigned int, unsigned int, unsigned short);
+void note_window_map_state(xcb_window_t, map_request_t, unsigned short);
+void flush_window_states(void);
+void finalize_window_states(void);
 
 void raise_window(xcb_window_t);
 void lower_window(xcb_window_t);
 
-void close_window(xcb_window_t);
+xcb_get_property_cookie_t request_protocols_of_window(xcb_window_t);
+unsigned int protocols_from_reply(xcb_get_property_cookie_t);
+unsigned int protocols_of_window(xcb_window_t);
+void close_window(xcb_window_t, unsigned int);
 
-void change_window_geometry(xcb_window_t, unsigned int, unsigned int,
-    unsigned int, unsigned int);
+void change_window_geometry(xcb_window_t, int, int, unsigned int,
+    unsigned int);
 
 void *get_window_property(xcb_window_t, xcb_atom_t, xcb_atom_t);
 char *name_of_window(xcb_window_t);
-char *class_of_window(xcb_window_t);
+xcb_get_property_cookie_t request_class_of_window(xcb_window_t);
+char *class_from_reply(xcb_get_property_cookie_t, char**);
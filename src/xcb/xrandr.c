@@ -1,13 +1,15 @@
 #include <xcb/xcb.h>
 
 #include "connection.h"
+#include "statistics.h"
 #include "xrandr.h"
 
 unsigned short xrandr_is_available() {
-    if (!xcb_get_extension_data(xcb_connection, &xcb_randr_id))
-        return 0;
+    const xcb_query_extension_reply_t *extension;
+    round_trip(extension = xcb_get_extension_data(xcb_connection,
+        &xcb_randr_id));
 
-    return 1;
+    return extension && extension->present;
 }
 
 xcb_randr_get_monitors_reply_t *get_xrandr_outputs() {
@@ -15,5 +17,9 @@ xcb_randr_get_monitors_reply_t *get_xrandr_outputs() {
     monitor_cookie = xcb_randr_get_monitors(xcb_connection, xcb_screen->root,
         XCB_NONE);
 
-    return xcb_randr_get_monitors_reply(xcb_connection, monitor_cookie, NULL);
+    xcb_randr_get_monitors_reply_t *outputs;
+    round_trip(outputs = xcb_randr_get_monitors_reply(xcb_connection,
+        monitor_cookie, NULL));
+
+    return outputs;
 }
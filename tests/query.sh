@@ -0,0 +1,59 @@
+#!/bin/sh
+#
+# Queries against a custard that has never managed a window. Needs Xvfb
+# and a built tree; run with make check.
+
+BUILD=${BUILD:-build}
+DISPLAY_NUMBER=${DISPLAY_NUMBER:-:73}
+
+if ! command -v Xvfb > /dev/null; then
+    echo "query: Xvfb not found, skipped"
+    exit 0
+fi
+
+scratch=$(mktemp -d)
+status=1
+
+cleanup() {
+    [ -n "$custard" ] && kill "$custard" 2> /dev/null
+    [ -n "$server" ] && kill "$server" 2> /dev/null
+    rm -rf "$scratch"
+}
+trap cleanup EXIT
+
+Xvfb "$DISPLAY_NUMBER" -nolisten tcp > /dev/null 2>&1 &
+server=$!
+sleep 1
+
+export DISPLAY="$DISPLAY_NUMBER"
+export XDG_CONFIG_HOME="$scratch"
+
+"$BUILD/custard" > "$scratch/log" 2>&1 &
+custard=$!
+
+# The socket shows up once custard is listening
+for attempt in 1 2 3 4 5 6 7 8 9 10; do
+    [ -S "/tmp/custard.${USER}_${DISPLAY}.sock" ] && break
+    sleep 0.5
+done
+
+if ! "$BUILD/custardc" query windows > "$scratch/windows"; then
+    echo "query: query windows failed"
+elif [ -s "$scratch/windows" ]; then
+    echo "query: query windows listed windows that do not exist"
+elif ! "$BUILD/custardc" query workspaces > "$scratch/workspaces"; then
+    echo "query: query workspaces failed"
+elif ! grep -q "^workspace" "$scratch/workspaces"; then
+    echo "query: query workspaces listed nothing"
+elif grep -v "windows=0$" "$scratch/workspaces" | grep -q .; then
+    echo "query: query workspaces counted windows that do not exist"
+elif ! kill -0 "$custard" 2> /dev/null; then
+    echo "query: custard did not survive the queries"
+else
+    echo "query: ok"
+    status=0
+fi
+
+[ "$status" -eq 0 ] && exit 0
+cat "$scratch/log"
+exit 1
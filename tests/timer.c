@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/timer.h"
+
+/*
+ * Timers fire once their delay has passed, in order, and never after
+ * they were cancelled; run with make check.
+ */
+
+static unsigned int fired[4];
+static long first_fired = -1;
+static unsigned int repeating = 0;
+
+static void record(void *data) {
+    unsigned long slot = (unsigned long)data;
+
+    fired[slot]++;
+    if (first_fired < 0)
+        first_fired = slot;
+}
+
+static void cancel_self(void *data) {
+    record(data);
+
+    /* Cancelling the running timer keeps it from being rearmed */
+    if (fired[(unsigned long)data] == 3)
+        cancel_timer(repeating);
+}
+
+static void run_until_idle() {
+    struct timespec pause;
+    int timeout;
+
+    for (unsigned int pass = 0; pass < 1000; pass++) {
+        if ((timeout = timer_timeout()) < 0)
+            return;
+
+        pause.tv_sec = timeout / 1000;
+        pause.tv_nsec = (timeout % 1000) * 1000000L + 100000L;
+        nanosleep(&pause, NULL);
+        run_timers();
+    }
+}
+
+static unsigned int check(const char *name, unsigned short passed) {
+    printf("timer: %s %s\n", name, passed ? "ok" : "failed");
+    return !passed;
+}
+
+int main() {
+    unsigned int failures = 0;
+
+    failures += check("idle without timers", timer_timeout() == -1);
+
+    add_timer(20000, 0, record, (void*)0);
+    unsigned int cancelled = add_timer(5000, 0, record, (void*)1);
+    defer(record, (void*)2);
+    repeating = add_timer(1000, 1000, cancel_self, (void*)3);
+
+    cancel_timer(cancelled);
+    run_until_idle();
+
+    failures += check("one-shot fires", fired[0] == 1);
+    failures += check("cancelled timer never fires", fired[1] == 0);
+    failures += check("deferred call fires first", fired[2] == 1 &&
+        first_fired == 2);
+    failures += check("repeating timer stops when cancelled",
+        fired[3] == 3);
+    failures += check("idle once everything ran", timer_timeout() == -1);
+
+    finalize_timers();
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}